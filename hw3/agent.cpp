@@ -18,8 +18,15 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <string.h>
+#include <signal.h>
+#include <vector>
 
 #include "def.h"
+#include "agent_core.h"
+#include "transport.h"
+#include "stats.h"
+#include "options.h"
+#include "log.h"
 
 void setIP(char *dst, const char *src){
     if (strcmp(src, "0.0.0.0") == 0 || strcmp(src, "local") == 0 || strcmp(src, "localhost") == 0) {
@@ -31,10 +38,41 @@ void setIP(char *dst, const char *src){
     return;
 }
 
-void corruptData(char* data, int len) {
-    for (int i = 0; i < len; ++i) {
-        data[i] = ~data[i];
-    }
+volatile sig_atomic_t stop = 0;
+
+/* seq numbers forwarded intact at least once: retransmissions are not goodput */
+std::vector<bool> forwarded;
+
+void countGoodput(segment *s) {
+    int seq = s->head.seqNumber;
+    if (seq <= 0) return;
+    if (seq >= (int)forwarded.size()) forwarded.resize(seq + 1 > 2 * (int)forwarded.size() ? seq + 1 : 2 * forwarded.size());
+    if (forwarded[seq]) return;
+    forwarded[seq] = true;
+    statInc(STAT_GOODPUT_BYTES, s->head.length);
+}
+
+/* Segments for the receiver wait here until the datagram they came in (one
+   or, with UDP GRO, several segments) is processed, then go out together */
+segment fwd_batch[GSO_MAX_SEGMENTS];
+segment *fwd_ptrs[GSO_MAX_SEGMENTS];
+int fwd_count = 0;
+bool fwd_gso = false;
+
+void flushForward(int sock, struct sockaddr_in *receiver) {
+    udpSendSegments(sock, receiver, fwd_ptrs, fwd_count, &fwd_gso);
+    fwd_count = 0;
+}
+
+void forward(int sock, struct sockaddr_in *receiver, segment *s) {
+    memcpy(&fwd_batch[fwd_count], s, sizeof(*s));
+    fwd_ptrs[fwd_count] = &fwd_batch[fwd_count];
+    fwd_count++;
+    if (fwd_count == GSO_MAX_SEGMENTS) flushForward(sock, receiver);
+}
+
+void handleStop(int) {
+    stop = 1;
 }
 
 int main(int argc, char* argv[]){
@@ -42,15 +80,15 @@ int main(int argc, char* argv[]){
     float error_rate;
     struct segment s_tmp;
     struct sockaddr_in sender, agent, receiver, tmp_addr;
-    socklen_t sender_size, recv_size, tmp_size;
+    socklen_t sender_size;
     char sendIP[50], agentIP[50], recvIP[50], tmpIP[50];
     int sendPort, agentPort, recvPort;
 
     setvbuf(stdin, 0, _IONBF, 0);
-    setvbuf(stdout, 0, _IONBF, 0);
     
-    if (argc != 7) {
-        fprintf(stderr,"Usage: %s <agent port> <sender IP> <sender port> <receiver IP> <receiver port> <error_rate>\n", argv[0]);
+    struct options opt;
+    if (argc < 7 || parseOptions(argc, argv, 7, AGENT_OPTIONS, &opt) != 0) {
+        fprintf(stderr,"Usage: %s <agent port> <sender IP> <sender port> <receiver IP> <receiver port> <error_rate> " AGENT_USAGE "\n", argv[0]);
         fprintf(stderr, "E.g., ./agent 8888 local 8887 local 8889 0.3\n");
         exit(1);
     }
@@ -68,6 +106,15 @@ int main(int argc, char* argv[]){
 
         sscanf(argv[6], "%f", &error_rate);
     }
+    statInit("agent", opt.stats_path, opt.stats_interval_ms);
+    logInit(!opt.no_log);
+
+    /* Ctrl+C / kill interrupts recvfrom (no SA_RESTART) so the agent can exit normally and report */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handleStop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
 
     /* Create UDP socket */
     agentsocket = socket(PF_INET, SOCK_DGRAM, 0);
@@ -95,8 +142,10 @@ int main(int argc, char* argv[]){
 
     /* Initialize size variable to be used later on */
     sender_size = sizeof(sender);
-    recv_size = sizeof(receiver);
-    tmp_size = sizeof(tmp_addr);
+
+    /* --offload: receive with UDP GRO, forward to the receiver with UDP GSO */
+    udp_reader reader(agentsocket, opt.offload);
+    fwd_gso = opt.offload;
 
     fprintf(stderr, "Start!! ^Q^\n");
     fprintf(stderr, "sender info: ip = %s port = %d and receiver info: ip = %s port = %d\n",
@@ -110,10 +159,10 @@ int main(int argc, char* argv[]){
     char *ptr;
     int portfrom;
     srand(time(NULL));
-    while (1) {
+    while (!stop) {
         /* Receive message from receiver and sender */
         memset(&s_tmp, 0, sizeof(s_tmp));
-        segment_size = recvfrom(agentsocket, &s_tmp, sizeof(s_tmp), 0, (struct sockaddr *)&tmp_addr, &tmp_size);
+        segment_size = reader.next(&s_tmp, &tmp_addr);
         if (segment_size > 0) {
             inet_ntop(AF_INET, &tmp_addr.sin_addr.s_addr, ipfrom, sizeof(ipfrom));
             portfrom = ntohs(tmp_addr.sin_port);
@@ -126,26 +175,32 @@ int main(int argc, char* argv[]){
                 }
                 total_data++;
                 if (s_tmp.head.fin == 1) {
-                    printf("get\tfin\n");
-                    sendto(agentsocket, &s_tmp, segment_size, 0, (struct sockaddr *)&receiver, recv_size);
-                    printf("fwd\tfin\n");
+                    LOG("get\tfin\n");
+                    forward(agentsocket, &receiver, &s_tmp);
+                    LOG("fwd\tfin\n");
                 }
                 else {
                     index = s_tmp.head.seqNumber;
-                    printf("get\tdata\t#%d\n", index);
-                    if (rand() % 10000 < 10000 * error_rate) {
+                    LOG("get\tdata\t#%d\n", index);
+                    statInc(STAT_DATA_RECV);
+                    int decision = agentDecide(error_rate, rand);
+                    if (decision != AGENT_FWD) {
                         error_data++;                        
-                        if (rand() % 2 == 0) {   // drop a packet
-                            printf("drop\tdata\t#%d,\terror rate = %.4f\n", index, (float)error_data/total_data);
+                        if (decision == AGENT_DROP) {   // drop a packet
+                            LOG("drop\tdata\t#%d,\terror rate = %.4f\n", index, (float)error_data/total_data);
+                            statInc(STAT_DATA_DROPPED);
                         }
                         else {  // corrupt a packet
-                            printf("corrupt\tdata\t#%d,\terror rate = %.4f\n", index, (float)error_data/total_data);
+                            LOG("corrupt\tdata\t#%d,\terror rate = %.4f\n", index, (float)error_data/total_data);
                             corruptData(s_tmp.data, MAX_SEG_SIZE);
-                            sendto(agentsocket, &s_tmp, segment_size, 0, (struct sockaddr *)&receiver, recv_size);
+                            forward(agentsocket, &receiver, &s_tmp);
+                            statInc(STAT_DATA_CORRUPTED);
                         }
                     } else {
-                        sendto(agentsocket, &s_tmp, segment_size, 0, (struct sockaddr *)&receiver, recv_size);
-                        printf("fwd\tdata\t#%d,\terror rate = %.4f\n", index, (float)error_data/total_data);
+                        forward(agentsocket, &receiver, &s_tmp);
+                        LOG("fwd\tdata\t#%d,\terror rate = %.4f\n", index, (float)error_data/total_data);
+                        statInc(STAT_DATA_SENT);
+                        countGoodput(&s_tmp);
                     }
                 }
             } 
@@ -156,14 +211,18 @@ int main(int argc, char* argv[]){
                     exit(1);
                 }
                 if (s_tmp.head.fin == 1) {
-                    printf("get\tfinack\n");
+                    LOG("get\tfinack\n");
                     sendto(agentsocket, &s_tmp, segment_size, 0, (struct sockaddr *)&sender, sender_size);
-                    printf("fwd\tfinack\n");
+                    LOG("fwd\tfinack\n");
+                    statInc(STAT_SYS_SENDTO);
                     break;
                 } else {
-                    printf("get\tack\t#%d,\tsack\t#%d\n", s_tmp.head.ackNumber, s_tmp.head.sackNumber);
+                    LOG("get\tack\t#%d,\tsack\t#%d\n", s_tmp.head.ackNumber, s_tmp.head.sackNumber);
+                    statInc(STAT_ACK_RECV);
                     sendto(agentsocket, &s_tmp, segment_size, 0, (struct sockaddr *)&sender, sender_size);
-                    printf("fwd\tack\t#%d,\tsack\t#%d\n", s_tmp.head.ackNumber, s_tmp.head.sackNumber);
+                    LOG("fwd\tack\t#%d,\tsack\t#%d\n", s_tmp.head.ackNumber, s_tmp.head.sackNumber);
+                    statInc(STAT_SYS_SENDTO);
+                    statInc(STAT_ACK_SENT);
                 }
             } else {
                 // this should not happen, something is wrong
@@ -174,6 +233,7 @@ int main(int argc, char* argv[]){
                 fprintf(stderr, "portfrom(%d) == recvPort(%d): %d\n", portfrom, recvPort, portfrom == recvPort);
             }
         }
+        if (fwd_count > 0 && !reader.pending()) flushForward(agentsocket, &receiver);
     }
 
     return 0;
@@ -0,0 +1,15 @@
+#include "agent_core.h"
+
+int agentDecide(float error_rate, int (*rand_fn)()){
+    if (rand_fn() % 10000 < 10000 * error_rate) {
+        if (rand_fn() % 2 == 0) return AGENT_DROP;
+        return AGENT_CORRUPT;
+    }
+    return AGENT_FWD;
+}
+
+void corruptData(char* data, int len) {
+    for (int i = 0; i < len; ++i) {
+        data[i] = ~data[i];
+    }
+}
@@ -0,0 +1,19 @@
+/*
+    What the agent does to a data segment from the sender, shared by the real
+    agent (agent.cpp) and the simulated link (sim.cpp).
+*/
+
+#ifndef AGENT_CORE_HEADER
+#define AGENT_CORE_HEADER
+
+#define AGENT_FWD 0
+#define AGENT_DROP 1
+#define AGENT_CORRUPT 2
+
+// With probability error_rate the segment is lost: half of the time it is
+// dropped, otherwise corrupted. rand_fn is rand() in the real agent.
+int agentDecide(float error_rate, int (*rand_fn)());
+
+void corruptData(char* data, int len);
+
+#endif // AGENT_CORE_HEADER
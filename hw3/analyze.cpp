@@ -0,0 +1,641 @@
+/*
+    Performance timeline from the sender / receiver / agent logs (the spec
+    lines checked by log_checker), for transfers whose logs are too big for
+    the Python parser. Files are mmap-ed and read once, front to back.
+
+    The logs have no timestamps, so time is counted in
+      - rounds: a round ends when the cumulative ACK covers every segment
+        that was outstanding when it began (about one RTT), or at a timeout,
+      - log lines of the sender,
+      - data segment arrivals (one ACK each) at the receiver, for flush stalls.
+    The agent log is lined up with the sender's: the i-th "get data" is the
+    i-th data segment the sender sent, unless the kernel dropped it first.
+
+        $ ./analyze sender_log.txt receiver_log.txt agent_log.txt --csv run1_
+    writes run1_rounds.csv, run1_bursts.csv and run1_flushes.csv besides the
+    summary on stdout. Any of the logs may be /dev/null.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "def.h"
+
+using namespace std;
+
+#define TOP_N 10
+
+// ---------------------------------------------------------------- parsing
+
+// One log file, mmap-ed and handed out a line at a time
+struct log_file {
+    const char *data = NULL, *pos = NULL, *end = NULL;
+    size_t size = 0;
+    long long line = 0;         // number of the line last returned
+    long long unparsed = 0;
+
+    void open(const char *path){
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0){
+            perror(path);
+            exit(1);
+        }
+        struct stat st;
+        fstat(fd, &st);
+        size = st.st_size;
+        if (size > 0){
+            void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED){
+                perror(path);
+                exit(1);
+            }
+            madvise(map, size, MADV_SEQUENTIAL);
+            data = (const char *)map;
+        }
+        close(fd);
+        pos = data;
+        end = data + size;
+    }
+
+    // [*begin, *stop) is the next line without its '\n'
+    bool next(const char **begin, const char **stop){
+        if (pos == NULL || pos >= end) return false;
+        const char *nl = (const char *)memchr(pos, '\n', end - pos);
+        *begin = pos;
+        *stop = nl ? nl : end;
+        pos = nl ? nl + 1 : end;
+        line++;
+        return true;
+    }
+};
+
+// Match a literal at p and move past it
+static bool eat(const char *&p, const char *end, const char *lit){
+    size_t len = strlen(lit);
+    if ((size_t)(end - p) < len || memcmp(p, lit, len) != 0) return false;
+    p += len;
+    return true;
+}
+
+static bool number(const char *&p, const char *end, long long *value){
+    if (p >= end || *p < '0' || *p > '9') return false;
+    *value = 0;
+    while (p < end && *p >= '0' && *p <= '9') *value = *value * 10 + (*p++ - '0');
+    return true;
+}
+
+enum line_kind {
+    L_UNKNOWN,
+    // sender
+    L_SEND_DATA, L_RESND_DATA, L_RECV_ACK, L_TIMEOUT, L_SEND_FIN, L_RECV_FINACK,
+    // receiver
+    L_RECV_IN_ORDER, L_RECV_OUT_OF_ORDER, L_DROP_OVERFLOW, L_DROP_CORRUPTED,
+    L_SEND_ACK, L_FLUSH, L_RECV_FIN, L_SEND_FINACK, L_SHA256, L_FINSHA,
+    // agent
+    L_GET_DATA, L_FWD_DATA, L_DROP_DATA, L_CORRUPT_DATA, L_GET_FIN,
+    L_OTHER,    // agent lines about ACKs / FIN, not needed here
+};
+
+struct log_line {
+    line_kind kind;
+    long long a, b;     // seq / ack / threshold, and sack / winSize / bytes
+};
+
+static log_line parseSender(const char *p, const char *end){
+    log_line l = {L_UNKNOWN, 0, 0};
+    if (eat(p, end, "send\tdata\t#")) l.kind = L_SEND_DATA;
+    else if (eat(p, end, "resnd\tdata\t#")) l.kind = L_RESND_DATA;
+
+    if (l.kind != L_UNKNOWN){
+        if (!number(p, end, &l.a) || !eat(p, end, ",\twinSize = ") || !number(p, end, &l.b)) l.kind = L_UNKNOWN;
+    }
+    else if (eat(p, end, "recv\tack\t#")){
+        l.kind = L_RECV_ACK;
+        if (!number(p, end, &l.a) || !eat(p, end, ",\tsack\t#") || !number(p, end, &l.b)) l.kind = L_UNKNOWN;
+    }
+    else if (eat(p, end, "time\tout,\tthreshold = ")){
+        l.kind = L_TIMEOUT;
+        if (!number(p, end, &l.a) || !eat(p, end, ",\twinSize = ") || !number(p, end, &l.b)) l.kind = L_UNKNOWN;
+    }
+    else if (eat(p, end, "send\tfin")) l.kind = L_SEND_FIN;
+    else if (eat(p, end, "recv\tfinack")) l.kind = L_RECV_FINACK;
+    return l;
+}
+
+static log_line parseReceiver(const char *p, const char *end){
+    log_line l = {L_UNKNOWN, 0, 0};
+    if (eat(p, end, "recv\tdata\t#")){
+        if (!number(p, end, &l.a)) return l;
+        if (eat(p, end, "\t(in order)")) l.kind = L_RECV_IN_ORDER;
+        else if (eat(p, end, "\t(out of order, sack-ed)")) l.kind = L_RECV_OUT_OF_ORDER;
+    }
+    else if (eat(p, end, "drop\tdata\t#")){
+        if (!number(p, end, &l.a)) return l;
+        if (eat(p, end, "\t(buffer overflow)")) l.kind = L_DROP_OVERFLOW;
+        else if (eat(p, end, "\t(corrupted)")) l.kind = L_DROP_CORRUPTED;
+    }
+    else if (eat(p, end, "send\tack\t#")){
+        l.kind = L_SEND_ACK;
+        if (!number(p, end, &l.a) || !eat(p, end, ",\tsack\t#") || !number(p, end, &l.b)) l.kind = L_UNKNOWN;
+    }
+    else if (eat(p, end, "flush")) l.kind = L_FLUSH;
+    else if (eat(p, end, "recv\tfin")) l.kind = L_RECV_FIN;
+    else if (eat(p, end, "send\tfinack")) l.kind = L_SEND_FINACK;
+    else if (eat(p, end, "sha256\t")){
+        l.kind = L_SHA256;
+        if (!number(p, end, &l.b)) l.kind = L_UNKNOWN;
+    }
+    else if (eat(p, end, "finsha\t")) l.kind = L_FINSHA;
+    return l;
+}
+
+static log_line parseAgent(const char *p, const char *end){
+    log_line l = {L_UNKNOWN, 0, 0};
+    if (eat(p, end, "get\tdata\t#")) l.kind = L_GET_DATA;
+    else if (eat(p, end, "fwd\tdata\t#")) l.kind = L_FWD_DATA;
+    else if (eat(p, end, "drop\tdata\t#")) l.kind = L_DROP_DATA;
+    else if (eat(p, end, "corrupt\tdata\t#")) l.kind = L_CORRUPT_DATA;
+    else if (eat(p, end, "get\tfinack")) l.kind = L_OTHER;
+    else if (eat(p, end, "get\tfin")) l.kind = L_GET_FIN;
+    else if (eat(p, end, "get\t") || eat(p, end, "fwd\t")) l.kind = L_OTHER;
+    if (l.kind >= L_GET_DATA && l.kind <= L_CORRUPT_DATA && !number(p, end, &l.a)) l.kind = L_UNKNOWN;
+    return l;
+}
+
+// ------------------------------------------------------------ agent cursor
+
+// What the agent did to the data segments the sender sent, in order
+struct agent_cursor {
+    log_file *file;
+    long long total = 0, dropped = 0, corrupted = 0;
+    long long lost_before_agent = 0;    // sent, but the agent never got it
+    bool has_pending = false;
+    log_line pending;                   // "get data" read ahead but not matched yet
+
+    // Returns L_FWD_DATA / L_DROP_DATA / L_CORRUPT_DATA, or L_UNKNOWN if the
+    // agent log has nothing for this segment
+    line_kind decide(long long seq){
+        if (!has_pending && !readGet()) return L_UNKNOWN;
+        if (pending.kind != L_GET_DATA || pending.a != seq){
+            // the agent's next segment is another one: this one never got there
+            lost_before_agent++;
+            return L_UNKNOWN;
+        }
+        has_pending = false;
+        total++;
+        const char *b, *e;
+        while (file->next(&b, &e)){
+            log_line l = parseAgent(b, e);
+            if (l.kind == L_UNKNOWN) file->unparsed++;
+            if (l.kind == L_FWD_DATA) return L_FWD_DATA;
+            if (l.kind == L_DROP_DATA){ dropped++; return L_DROP_DATA; }
+            if (l.kind == L_CORRUPT_DATA){ corrupted++; return L_CORRUPT_DATA; }
+        }
+        return L_UNKNOWN;
+    }
+
+    bool readGet(){
+        const char *b, *e;
+        while (file->next(&b, &e)){
+            log_line l = parseAgent(b, e);
+            if (l.kind == L_UNKNOWN) file->unparsed++;
+            if (l.kind == L_GET_DATA || l.kind == L_GET_FIN){
+                pending = l;
+                has_pending = true;
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// ------------------------------------------------------------ sender replay
+
+enum recovery_kind { REC_NONE, REC_FAST, REC_TIMEOUT };
+static const char *recovery_name[] = {"", "fast_retransmit", "timeout"};
+
+struct round_info {
+    long long first_line, last_line;
+    int cwnd, thresh;
+    long long sent, resent, acked, dup_acks;
+    long long goodput_bytes;    // of the acked segments, see countGoodput()
+    long long agent_dropped, agent_corrupted;
+    int timeouts, fast_retransmits;
+    recovery_kind recovery;     // worst recovery the round was in
+};
+
+struct burst_info {
+    long long first_line, last_line, count;
+    long long min_seq, max_seq;
+    const char *cause;
+};
+
+struct sender_summary {
+    vector<round_info> rounds;
+    vector<burst_info> bursts;
+    long long lines = 0, sent = 0, resent = 0, acked = 0;
+    long long timeouts = 0, fast_retransmits = 0;
+    long long last_seq = 0, last_seq_round = 0; // highest seq acked and the round that acked it
+    long long lines_in[3] = {0, 0, 0}, rounds_in[3] = {0, 0, 0};
+    int max_cwnd = 0;
+};
+
+static void replaySender(log_file *file, agent_cursor *agent, sender_summary *s){
+    vector<bool> acked(1, false);       // acked[seq]
+    long long acked_upto = 0;           // every seq <= acked_upto is acked
+    long long base = 1, dup_ack = 0, max_sent = 0;
+    int thresh = 0, cwnd = 1;
+    recovery_kind recovery = REC_NONE;
+    long long recover_point = 0;        // recovery ends when this seq is acked
+    // the resend of base right after the 3rd dup ACK / right after a timeout
+    bool fast_pending = false, timeout_pending = false;
+    bool in_burst = false;
+
+    round_info r = {};
+    long long round_mark = 0;           // the round ends when this seq is acked
+    auto startRound = [&](long long line){
+        r = {};
+        r.first_line = line;
+        r.recovery = recovery;
+        round_mark = max(max_sent, acked_upto + 1);
+    };
+    auto endRound = [&](long long line){
+        r.last_line = line;
+        r.cwnd = cwnd;
+        r.thresh = thresh;
+        s->rounds.push_back(r);
+        s->rounds_in[r.recovery]++;
+    };
+    auto markAcked = [&](long long seq){
+        if (seq < 1) return;
+        if ((long long)acked.size() <= seq) acked.resize(max((long long)acked.size() * 2, seq + 1), false);
+        if (!acked[seq]){
+            acked[seq] = true;
+            r.acked++;
+            s->acked++;
+            if (seq > s->last_seq) s->last_seq = seq, s->last_seq_round = s->rounds.size();
+        }
+    };
+
+    startRound(1);
+    const char *b, *e;
+    while (file->next(&b, &e)){
+        long long line = file->line;
+        log_line l = parseSender(b, e);
+        s->lines_in[recovery]++;
+        switch (l.kind){
+        case L_SEND_DATA:
+        case L_RESND_DATA:{
+            cwnd = l.b;
+            s->max_cwnd = max(s->max_cwnd, cwnd);
+            if (l.kind == L_SEND_DATA){
+                r.sent++, s->sent++;
+                in_burst = false;
+            }
+            else{
+                r.resent++, s->resent++;
+                // dupACK() may send from the window before the fast retransmit itself
+                const char *cause = "window";
+                if (fast_pending && l.a == base) cause = "fast_retransmit", fast_pending = false;
+                else if (timeout_pending) cause = "timeout";
+                if (!in_burst || strcmp(cause, "window") != 0){
+                    s->bursts.push_back({line, line, 0, l.a, l.a, cause});
+                    in_burst = true;
+                }
+                burst_info &burst = s->bursts.back();
+                burst.last_line = line;
+                burst.count++;
+                burst.min_seq = min(burst.min_seq, l.a);
+                burst.max_seq = max(burst.max_seq, l.a);
+            }
+            timeout_pending = false;
+            max_sent = max(max_sent, l.a);
+            line_kind decision = agent->decide(l.a);
+            if (decision == L_DROP_DATA) r.agent_dropped++;
+            if (decision == L_CORRUPT_DATA) r.agent_corrupted++;
+            break;
+        }
+        case L_RECV_ACK:
+            fast_pending = false;
+            markAcked(l.b);
+            if (l.a < base){
+                // same test as sender_fsm::handleAck
+                dup_ack++;
+                r.dup_acks++;
+                if (dup_ack == 3){
+                    r.fast_retransmits++, s->fast_retransmits++;
+                    fast_pending = true;
+                    recovery = REC_FAST;
+                    recover_point = max_sent;
+                    r.recovery = max(r.recovery, recovery);
+                }
+            }
+            else{
+                dup_ack = 0;
+                for (long long k = acked_upto + 1; k <= l.a; k++) markAcked(k);
+                acked_upto = max(acked_upto, l.a);
+                base = l.a + 1;
+                if (recovery != REC_NONE && acked_upto >= recover_point) recovery = REC_NONE;
+                if (acked_upto >= round_mark){
+                    endRound(line);
+                    startRound(line + 1);
+                }
+            }
+            break;
+        case L_TIMEOUT:
+            thresh = l.a;
+            cwnd = l.b;
+            dup_ack = 0;
+            r.timeouts++, s->timeouts++;
+            timeout_pending = true;
+            recovery = REC_TIMEOUT;
+            recover_point = max_sent;
+            r.recovery = recovery;
+            endRound(line);
+            startRound(line + 1);
+            break;
+        case L_SEND_FIN:
+        case L_RECV_FINACK:
+            break;
+        default:
+            file->unparsed++;
+        }
+    }
+    s->lines = file->line;
+    if (r.sent + r.resent + r.acked + r.dup_acks > 0) endRound(file->line);
+}
+
+// ---------------------------------------------------------- receiver replay
+
+struct flush_info {
+    long long first_line, last_line;
+    long long accepted, out_of_order, overflow, corrupted;
+    long long stalled_acks;     // ACKs sent while a hole was below a sack-ed segment
+    long long longest_stall;    // longest run of such ACKs
+    long long bytes;            // delivered by this flush (from the sha256 line)
+};
+
+struct receiver_summary {
+    vector<flush_info> flushes;
+    long long lines = 0, acks = 0, accepted = 0, overflow = 0, corrupted = 0, stalled_acks = 0;
+    long long delivered_bytes = 0;
+};
+
+static void replayReceiver(log_file *file, receiver_summary *s){
+    flush_info f = {};
+    f.first_line = 1;
+    long long cum_ack = 0, max_sacked = 0, stall_run = 0;
+    long long last_bytes = 0;
+
+    const char *b, *e;
+    while (file->next(&b, &e)){
+        long long line = file->line;
+        log_line l = parseReceiver(b, e);
+        switch (l.kind){
+        case L_RECV_IN_ORDER:
+        case L_RECV_OUT_OF_ORDER:
+            f.accepted++, s->accepted++;
+            if (l.kind == L_RECV_OUT_OF_ORDER) f.out_of_order++;
+            max_sacked = max(max_sacked, l.a);
+            break;
+        case L_DROP_OVERFLOW:
+            f.overflow++, s->overflow++;
+            break;
+        case L_DROP_CORRUPTED:
+            f.corrupted++, s->corrupted++;
+            break;
+        case L_SEND_ACK:
+            // every arriving data segment is answered by one ACK
+            cum_ack = max(cum_ack, l.a);
+            s->acks++;
+            if (max_sacked > cum_ack){
+                // the in-order point is stuck behind a missing segment
+                f.stalled_acks++, s->stalled_acks++;
+                f.longest_stall = max(f.longest_stall, ++stall_run);
+            }
+            else stall_run = 0;
+            break;
+        case L_FLUSH:
+            f.last_line = line;
+            s->flushes.push_back(f);
+            f = {};
+            f.first_line = line + 1;
+            stall_run = 0;
+            break;
+        case L_SHA256:
+            // belongs to the flush just before it
+            if (!s->flushes.empty()) s->flushes.back().bytes = l.b - last_bytes;
+            last_bytes = l.b;
+            s->delivered_bytes = l.b;
+            break;
+        case L_RECV_FIN:
+        case L_SEND_FINACK:
+        case L_FINSHA:
+            break;
+        default:
+            file->unparsed++;
+        }
+    }
+    s->lines = file->line;
+    if (f.accepted + f.overflow + f.corrupted > 0){
+        f.last_line = file->line;
+        s->flushes.push_back(f);
+    }
+}
+
+// Every segment but the last of the transfer is MAX_SEG_SIZE long, the
+// last one's size comes from the bytes the receiver delivered. Without a
+// receiver log, or when that does not fit (manifest transfers have a short
+// segment at the end of every file), all are counted as MAX_SEG_SIZE.
+static void countGoodput(sender_summary *s, const receiver_summary &rs){
+    for (round_info &r : s->rounds) r.goodput_bytes = r.acked * MAX_SEG_SIZE;
+    long long last_bytes = rs.delivered_bytes - (s->last_seq - 1) * MAX_SEG_SIZE;
+    if (s->last_seq < 1 || last_bytes < 0 || last_bytes > MAX_SEG_SIZE) return;
+    if (s->last_seq_round < (long long)s->rounds.size()){
+        s->rounds[s->last_seq_round].goodput_bytes -= MAX_SEG_SIZE - last_bytes;
+    }
+}
+
+// ------------------------------------------------------------------ report
+
+static FILE *openCsv(const string &prefix, const char *name){
+    string path = prefix + name;
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL){
+        perror(path.c_str());
+        exit(1);
+    }
+    return fp;
+}
+
+static void writeCsv(const string &prefix, const sender_summary &s, const receiver_summary &rs){
+    FILE *fp = openCsv(prefix, "rounds.csv");
+    fprintf(fp, "round,first_line,last_line,cwnd,thresh,sent,resent,acked_segments,goodput_bytes,"
+                "dup_acks,agent_dropped,agent_corrupted,timeouts,fast_retransmits,recovery\n");
+    for (size_t i = 0; i < s.rounds.size(); i++){
+        const round_info &r = s.rounds[i];
+        fprintf(fp, "%zu,%lld,%lld,%d,%d,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%d,%d,%s\n",
+            i, r.first_line, r.last_line, r.cwnd, r.thresh, r.sent, r.resent, r.acked,
+            r.goodput_bytes, r.dup_acks, r.agent_dropped, r.agent_corrupted,
+            r.timeouts, r.fast_retransmits, recovery_name[r.recovery]);
+    }
+    fclose(fp);
+
+    fp = openCsv(prefix, "bursts.csv");
+    fprintf(fp, "first_line,last_line,count,min_seq,max_seq,cause\n");
+    for (const burst_info &burst : s.bursts){
+        fprintf(fp, "%lld,%lld,%lld,%lld,%lld,%s\n", burst.first_line, burst.last_line,
+            burst.count, burst.min_seq, burst.max_seq, burst.cause);
+    }
+    fclose(fp);
+
+    fp = openCsv(prefix, "flushes.csv");
+    fprintf(fp, "flush,first_line,last_line,accepted,out_of_order,overflow,corrupted,"
+                "stalled_acks,longest_stall,bytes\n");
+    for (size_t i = 0; i < rs.flushes.size(); i++){
+        const flush_info &f = rs.flushes[i];
+        fprintf(fp, "%zu,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld,%lld\n", i, f.first_line, f.last_line,
+            f.accepted, f.out_of_order, f.overflow, f.corrupted, f.stalled_acks, f.longest_stall, f.bytes);
+    }
+    fclose(fp);
+}
+
+static void printSummary(const sender_summary &s, const receiver_summary &rs, const agent_cursor &agent,
+                         int intervals, int timeout_ms){
+    long long nrounds = s.rounds.size();
+    printf("== sender: %lld lines, %lld rounds\n", s.lines, nrounds);
+    printf("sent %lld, resent %lld (%.2f%%), acked segments %lld, max cwnd %d\n",
+        s.sent, s.resent, s.sent ? 100.0 * s.resent / s.sent : 0, s.acked, s.max_cwnd);
+
+    // cwnd and goodput per interval, each interval is a range of rounds
+    if (nrounds > 0){
+        long long per = max(1LL, (nrounds + intervals - 1) / intervals);
+        printf("\n%-13s %-17s %8s %8s %8s %8s %10s %12s %6s\n", "rounds", "sender lines", "cwnd",
+            "min", "max", "resent", "acked", "bytes/round", "loss");
+        for (long long i = 0; i < nrounds; i += per){
+            long long j = min(nrounds, i + per);
+            long long acked = 0, goodput = 0, resent = 0, lost = 0, got = 0;
+            int lo = s.rounds[i].cwnd, hi = lo;
+            for (long long k = i; k < j; k++){
+                const round_info &r = s.rounds[k];
+                acked += r.acked, goodput += r.goodput_bytes, resent += r.resent;
+                lost += r.agent_dropped + r.agent_corrupted;
+                got += r.sent + r.resent;
+                lo = min(lo, r.cwnd), hi = max(hi, r.cwnd);
+            }
+            printf("%5lld-%-7lld %7lld-%-9lld %8d %8d %8d %8lld %10lld %12lld %5.1f%%\n",
+                i, j - 1, s.rounds[i].first_line, s.rounds[j - 1].last_line, s.rounds[j - 1].cwnd,
+                lo, hi, resent, acked, goodput / (j - i), got ? 100.0 * lost / got : 0);
+        }
+    }
+
+    printf("\n== loss recovery\n");
+    printf("%-16s %8s %8s %8s %14s\n", "", "events", "rounds", "lines", "idle (est.)");
+    printf("%-16s %8lld %8lld %8lld %11lld ms\n", "timeout", s.timeouts, s.rounds_in[REC_TIMEOUT],
+        s.lines_in[REC_TIMEOUT], s.timeouts * timeout_ms);
+    printf("%-16s %8lld %8lld %8lld %14s\n", "fast retransmit", s.fast_retransmits, s.rounds_in[REC_FAST],
+        s.lines_in[REC_FAST], "-");
+    printf("%-16s %8s %8lld %8lld\n", "no recovery", "", s.rounds_in[REC_NONE], s.lines_in[REC_NONE]);
+
+    vector<burst_info> bursts = s.bursts;
+    long long by_cause[3] = {0, 0, 0};
+    for (const burst_info &burst : bursts){
+        if (strcmp(burst.cause, "timeout") == 0) by_cause[0] += burst.count;
+        else if (strcmp(burst.cause, "fast_retransmit") == 0) by_cause[1] += burst.count;
+        else by_cause[2] += burst.count;
+    }
+    printf("\n== retransmission bursts: %zu, resent after timeout %lld, after fast retransmit %lld, "
+           "in window %lld\n", bursts.size(), by_cause[0], by_cause[1], by_cause[2]);
+    sort(bursts.begin(), bursts.end(),
+         [](const burst_info &a, const burst_info &b){ return a.count > b.count; });
+    for (size_t i = 0; i < bursts.size() && i < TOP_N; i++){
+        const burst_info &burst = bursts[i];
+        printf("%6lld segments #%lld-#%lld, lines %lld-%lld (%s)\n", burst.count,
+            burst.min_seq, burst.max_seq, burst.first_line, burst.last_line, burst.cause);
+    }
+
+    printf("\n== agent: %lld data segments matched, %lld dropped, %lld corrupted", agent.total,
+        agent.dropped, agent.corrupted);
+    if (agent.lost_before_agent > 0) printf(", %lld sent but never reached the agent", agent.lost_before_agent);
+    printf("\n");
+
+    printf("\n== receiver: %lld lines, %zu flushes, %lld bytes delivered\n", rs.lines,
+        rs.flushes.size(), rs.delivered_bytes);
+    printf("accepted %lld, dropped on buffer overflow %lld, corrupted %lld\n",
+        rs.accepted, rs.overflow, rs.corrupted);
+    if (rs.acks > 0){
+        printf("stalled (hole below a sack-ed segment) for %lld of %lld ACKs, %.1f%%\n",
+            rs.stalled_acks, rs.acks, 100.0 * rs.stalled_acks / rs.acks);
+    }
+    vector<flush_info> flushes = rs.flushes;
+    sort(flushes.begin(), flushes.end(),
+         [](const flush_info &a, const flush_info &b){ return a.stalled_acks > b.stalled_acks; });
+    for (size_t i = 0; i < flushes.size() && i < TOP_N && flushes[i].stalled_acks > 0; i++){
+        const flush_info &f = flushes[i];
+        printf("%6lld stalled ACKs (longest run %lld), lines %lld-%lld, %lld overflow drops\n",
+            f.stalled_acks, f.longest_stall, f.first_line, f.last_line, f.overflow);
+    }
+}
+
+static void usage(const char *prog){
+    fprintf(stderr,
+        "Usage: %s <sender_log> <receiver_log> <agent_log> [options]\n"
+        "  --csv <prefix>       also write <prefix>rounds.csv, <prefix>bursts.csv, <prefix>flushes.csv\n"
+        "  --intervals <n>      rows of the cwnd / goodput table (default 20)\n"
+        "  --timeout-ms <n>     sender's timeout, for the idle time estimate (default %d)\n",
+        prog, TIMEOUT_MILLISECONDS);
+    exit(1);
+}
+
+int main(int argc, char *argv[]){
+    const char *csv = NULL;
+    int intervals = 20, timeout_ms = TIMEOUT_MILLISECONDS;
+
+    static struct option long_options[] = {
+        {"csv", required_argument, 0, 'c'},
+        {"intervals", required_argument, 0, 'i'},
+        {"timeout-ms", required_argument, 0, 'o'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1){
+        switch (c){
+            case 'c': csv = optarg; break;
+            case 'i': intervals = max(1, atoi(optarg)); break;
+            case 'o': timeout_ms = atoi(optarg); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind != 3) usage(argv[0]);
+
+    log_file sender_log, receiver_log, agent_log;
+    sender_log.open(argv[optind]);
+    receiver_log.open(argv[optind + 1]);
+    agent_log.open(argv[optind + 2]);
+
+    agent_cursor agent;
+    agent.file = &agent_log;
+    sender_summary s;
+    replaySender(&sender_log, &agent, &s);
+    receiver_summary rs;
+    replayReceiver(&receiver_log, &rs);
+    countGoodput(&s, rs);
+
+    printSummary(s, rs, agent, intervals, timeout_ms);
+    if (csv != NULL) writeCsv(csv, s, rs);
+
+    long long unparsed = sender_log.unparsed + receiver_log.unparsed + agent_log.unparsed;
+    if (unparsed > 0){
+        fprintf(stderr, "Skipped %lld lines that are not spec log lines (run log_checker on them)\n", unparsed);
+    }
+    return 0;
+}
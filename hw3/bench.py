@@ -0,0 +1,193 @@
+"""
+    End-to-end throughput benchmark over loopback.
+
+    For every combination of file size, error rate and initial threshold, launch
+    agent, receiver and sender (in that order, like README.md says), wait for the
+    transfer to finish and record:
+        wall time, goodput, retransmission ratio, CPU time of each process
+    and check that the received file has the same sha256 as the source.
+
+    Usage:
+        $ make && python3 bench.py --sizes 1M,5M --error-rates 0,0.1 --runs 3 \\
+              --csv bench_results.csv --json bench_results.json
+
+    Extra flags for the binaries can be passed with --sender-args etc., e.g.
+    --sender-args "--no-log". Every run is also printed as it finishes; compare
+    the CSV of two commits to see the effect of a protocol change.
+"""
+
+import argparse
+import csv
+import hashlib
+import json
+import os
+import random
+import shlex
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+
+HW3 = Path(__file__).resolve().parent
+MAX_FILE_SIZE = 10240000    # FILESIZE in sender.cpp / receiver.cpp
+
+FIELDS = ['size', 'error_rate', 'thresh', 'run', 'ok', 'wall_s', 'goodput_mbps',
+          'data_sent', 'data_resent', 'retrans_ratio', 'timeouts', 'fast_retransmits',
+          'sender_cpu_s', 'receiver_cpu_s', 'agent_cpu_s']
+
+
+def parseSize(s: str) -> int:
+    units = {'K': 1000, 'M': 1000 * 1000}
+    if s[-1].upper() in units:
+        return int(float(s[:-1]) * units[s[-1].upper()])
+    return int(s)
+
+
+def freePorts(n: int):
+    socks = []
+    for _ in range(n):
+        s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        s.bind(('127.0.0.1', 0))
+        socks.append(s)
+    ports = [s.getsockname()[1] for s in socks]
+    for s in socks:
+        s.close()
+    return ports
+
+
+def sha256(path: Path) -> str:
+    h = hashlib.sha256()
+    with open(path, 'rb') as fin:
+        for chunk in iter(lambda: fin.read(1 << 20), b''):
+            h.update(chunk)
+    return h.hexdigest()
+
+
+def waitCpu(proc: subprocess.Popen, timeout: float):
+    """ Wait for proc and return (returncode, user + sys CPU seconds), kill it after timeout. """
+    deadline = time.monotonic() + timeout
+    while True:
+        pid, status, usage = os.wait4(proc.pid, os.WNOHANG)
+        if pid == proc.pid:
+            proc.returncode = os.waitstatus_to_exitcode(status)
+            return proc.returncode, usage.ru_utime + usage.ru_stime
+        if time.monotonic() > deadline:
+            proc.kill()
+            _, status, usage = os.wait4(proc.pid, 0)
+            proc.returncode = os.waitstatus_to_exitcode(status)
+            return None, usage.ru_utime + usage.ru_stime
+        time.sleep(0.005)
+
+
+def runOnce(args, workdir: Path, src: Path, error_rate: float, thresh: int):
+    send_port, agent_port, recv_port = freePorts(3)
+    dst = workdir / 'dst'
+    stats = workdir / 'sender_stats.json'
+    dst.unlink(missing_ok=True)
+    stats.unlink(missing_ok=True)
+    logs = {name: open(workdir / f'{name}_log.txt', 'wb') for name in ('agent', 'receiver', 'sender')}
+
+    agent = subprocess.Popen([str(HW3 / 'agent'), str(agent_port), 'local', str(send_port), 'local',
+                              str(recv_port), str(error_rate)] + shlex.split(args.agent_args),
+                             stdout=logs['agent'], stderr=subprocess.DEVNULL)
+    time.sleep(args.startup_delay)
+    receiver = subprocess.Popen([str(HW3 / 'receiver'), 'local', str(recv_port), 'local', str(agent_port),
+                                 str(dst)] + shlex.split(args.receiver_args),
+                                stdout=logs['receiver'], stderr=subprocess.DEVNULL)
+    time.sleep(args.startup_delay)
+
+    sender_cmd = [str(HW3 / 'sender'), 'local', str(send_port), 'local', str(agent_port), str(src),
+                  '--stats', str(stats)] + shlex.split(args.sender_args)
+    if thresh > 0:
+        sender_cmd += ['--thresh', str(thresh)]
+    start = time.monotonic()
+    sender = subprocess.Popen(sender_cmd, stdout=logs['sender'], stderr=subprocess.DEVNULL)
+    sender_rc, sender_cpu = waitCpu(sender, args.timeout)
+    wall = time.monotonic() - start
+
+    # receiver and agent exit by themselves once the FIN / FINACK went through
+    receiver_rc, receiver_cpu = waitCpu(receiver, 5)
+    agent_rc, agent_cpu = waitCpu(agent, 5)
+    for f in logs.values():
+        f.close()
+
+    size = src.stat().st_size
+    ok = sender_rc == 0 and receiver_rc == 0 and dst.exists() and sha256(dst) == sha256(src)
+    counters = {}
+    if stats.exists() and stats.stat().st_size > 0:
+        with open(stats) as fin:
+            counters = json.loads(fin.read().splitlines()[-1])['counters']
+    data_sent = counters.get('data_sent', 0)
+    data_resent = counters.get('data_resent', 0)
+    return {
+        'ok': ok,
+        'wall_s': round(wall, 4),
+        'goodput_mbps': round(size * 8 / wall / 1e6, 3) if ok else 0,
+        'data_sent': data_sent,
+        'data_resent': data_resent,
+        'retrans_ratio': round(data_resent / data_sent, 4) if data_sent else 0,
+        'timeouts': counters.get('timeout', 0),
+        'fast_retransmits': counters.get('fast_retransmit', 0),
+        'sender_cpu_s': round(sender_cpu, 4),
+        'receiver_cpu_s': round(receiver_cpu, 4),
+        'agent_cpu_s': round(agent_cpu, 4),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Loopback throughput benchmark for agent / receiver / sender.')
+    parser.add_argument('--sizes', default='1M', help='comma separated file sizes, K / M suffix allowed')
+    parser.add_argument('--error-rates', default='0,0.1', help='comma separated agent error rates')
+    parser.add_argument('--thresh', default='0', help='comma separated initial thresholds (0: sender default)')
+    parser.add_argument('--runs', type=int, default=1, help='runs per configuration')
+    parser.add_argument('--timeout', type=float, default=300, help='seconds before a sender is killed')
+    parser.add_argument('--startup-delay', type=float, default=0.2, help='seconds between launching processes')
+    parser.add_argument('--sender-args', default='', help='extra flags for sender')
+    parser.add_argument('--receiver-args', default='', help='extra flags for receiver')
+    parser.add_argument('--agent-args', default='', help='extra flags for agent')
+    parser.add_argument('--seed', type=int, default=0, help='seed for the generated source files (0: random)')
+    parser.add_argument('--csv', help='write results as CSV')
+    parser.add_argument('--json', help='write results as JSON')
+    args = parser.parse_args()
+
+    for binary in ('agent', 'receiver', 'sender'):
+        if not (HW3 / binary).exists():
+            sys.exit(f'{binary} not found, run make first')
+
+    sizes = [parseSize(s) for s in args.sizes.split(',')]
+    error_rates = [float(e) for e in args.error_rates.split(',')]
+    threshes = [int(t) for t in args.thresh.split(',')]
+    if max(sizes) > MAX_FILE_SIZE:
+        sys.exit(f'file size is limited to {MAX_FILE_SIZE} bytes')
+
+    results = []
+    with tempfile.TemporaryDirectory(prefix='hw3_bench_') as tmp:
+        workdir = Path(tmp)
+        for size in sizes:
+            src = workdir / f'src_{size}'
+            with open(src, 'wb') as fout:
+                fout.write(random.Random(args.seed).randbytes(size) if args.seed else os.urandom(size))
+            for error_rate in error_rates:
+                for thresh in threshes:
+                    for run in range(args.runs):
+                        row = {'size': size, 'error_rate': error_rate, 'thresh': thresh, 'run': run}
+                        row.update(runOnce(args, workdir, src, error_rate, thresh))
+                        results.append(row)
+                        print(', '.join(f'{k}={row[k]}' for k in FIELDS), flush=True)
+
+    if args.csv:
+        with open(args.csv, 'w', newline='') as fout:
+            writer = csv.DictWriter(fout, fieldnames=FIELDS)
+            writer.writeheader()
+            writer.writerows(results)
+    if args.json:
+        with open(args.json, 'w') as fout:
+            json.dump(results, fout, indent=2)
+    if not all(row['ok'] for row in results):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
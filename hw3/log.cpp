@@ -0,0 +1,200 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <errno.h>
+#include <csignal>
+#include <mutex>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "log.h"
+#include "stats.h"
+
+using namespace std;
+
+#define LOG_RING_MASK (LOG_RING_SIZE - 1)
+#define LOG_LINE_SIZE 512
+
+// single producer (the owning thread), single consumer (whoever holds drain_mutex)
+struct log_ring {
+    char data[LOG_RING_SIZE];
+    atomic<size_t> head; // next byte the producer writes
+    atomic<size_t> tail; // next byte the consumer writes out
+};
+
+bool log_enabled = false;
+
+static vector<log_ring *> rings;
+static mutex rings_mutex;   // protects `rings`
+static mutex drain_mutex;   // only one consumer writes to stdout at a time
+static mutex cv_mutex;
+static condition_variable cv;
+static atomic<bool> stopping(false);
+static thread *flusher;
+static thread_local log_ring *my_ring;
+static volatile sig_atomic_t caught_signal = 0;
+
+static void writeAll(const struct iovec *iov, int iovcnt){
+    struct iovec v[2];
+    for (int i = 0; i < iovcnt; i++) v[i] = iov[i];
+    struct iovec *p = v;
+    while (iovcnt > 0){
+        ssize_t n = writev(STDOUT_FILENO, p, iovcnt);
+        statInc(STAT_SYS_LOG_WRITE);
+        if (n < 0){
+            if (errno == EINTR) continue;
+            return; // stdout is gone, nothing sensible left to do
+        }
+        while (iovcnt > 0 && (size_t)n >= p->iov_len){
+            n -= p->iov_len;
+            p++, iovcnt--;
+        }
+        if (iovcnt > 0){
+            p->iov_base = (char *)p->iov_base + n;
+            p->iov_len -= n;
+        }
+    }
+}
+
+// Write out everything the ring holds, caller must hold drain_mutex
+static void drainRing(log_ring *r){
+    size_t head = r->head.load(memory_order_acquire);
+    size_t tail = r->tail.load(memory_order_relaxed);
+    if (head == tail) return;
+
+    // at most two pieces when the buffered bytes wrap around the end
+    struct iovec iov[2];
+    int iovcnt = 0;
+    size_t first = LOG_RING_SIZE - (tail & LOG_RING_MASK);
+    if (first > head - tail) first = head - tail;
+    iov[iovcnt].iov_base = r->data + (tail & LOG_RING_MASK);
+    iov[iovcnt++].iov_len = first;
+    if (head - tail > first){
+        iov[iovcnt].iov_base = r->data;
+        iov[iovcnt++].iov_len = head - tail - first;
+    }
+    writeAll(iov, iovcnt);
+    r->tail.store(head, memory_order_release);
+}
+
+static void drainAll(){
+    lock_guard<mutex> lock(rings_mutex);
+    for (log_ring *r : rings) drainRing(r);
+}
+
+void logFlush(){
+    lock_guard<mutex> lock(drain_mutex);
+    drainAll();
+}
+
+static log_ring *getRing(){
+    if (my_ring == NULL){
+        my_ring = new log_ring();
+        lock_guard<mutex> lock(rings_mutex);
+        rings.push_back(my_ring);
+    }
+    return my_ring;
+}
+
+void logWrite(const char *fmt, ...){
+    char line[LOG_LINE_SIZE];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (n <= 0) return;
+
+    const char *p = line;
+    vector<char> long_line;
+    if (n >= LOG_LINE_SIZE){
+        long_line.resize(n + 1);
+        va_start(ap, fmt);
+        vsnprintf(long_line.data(), n + 1, fmt, ap);
+        va_end(ap);
+        p = long_line.data();
+    }
+
+    log_ring *r = getRing();
+    size_t head = r->head.load(memory_order_relaxed);
+    size_t used = head - r->tail.load(memory_order_acquire);
+    if (used + n > LOG_RING_SIZE){
+        // the flusher fell behind (or the line is huge): drain inline instead of waiting
+        lock_guard<mutex> lock(drain_mutex);
+        drainAll();
+        used = 0;
+        if ((size_t)n > LOG_RING_SIZE){
+            struct iovec iov = {(void *)p, (size_t)n};
+            writeAll(&iov, 1);
+            return;
+        }
+    }
+
+    size_t off = head & LOG_RING_MASK;
+    size_t first = LOG_RING_SIZE - off;
+    if (first >= (size_t)n){
+        memcpy(r->data + off, p, n);
+    }
+    else{
+        memcpy(r->data + off, p, first);
+        memcpy(r->data, p + first, n - first);
+    }
+    r->head.store(head + n, memory_order_release);
+
+    // wake the flusher early only when crossing half full, not on every line
+    if (used < LOG_RING_SIZE / 2 && used + n >= LOG_RING_SIZE / 2){
+        cv.notify_one();
+    }
+}
+
+static void flushPeriodically(){
+    while (!stopping.load()){
+        {
+            unique_lock<mutex> lock(cv_mutex);
+            cv.wait_for(lock, chrono::milliseconds(LOG_FLUSH_MILLISECONDS));
+        }
+        logFlush();
+        if (caught_signal != 0){
+            // written out, now die of the signal the way the process would have
+            signal(caught_signal, SIG_DFL);
+            raise(caught_signal);
+        }
+    }
+}
+
+// Only records the signal (nothing else is async-signal-safe here), the
+// flusher picks it up within LOG_FLUSH_MILLISECONDS
+static void onSignal(int signo){
+    caught_signal = signo;
+}
+
+static void logShutdown(){
+    stopping.store(true);
+    cv.notify_one();
+    flusher->join();
+    logFlush();
+}
+
+void logInit(bool enabled){
+    log_enabled = enabled;
+    if (!enabled) return;
+    flusher = new thread(flushPeriodically);
+    atexit(logShutdown);
+
+    int signals[] = {SIGINT, SIGTERM};
+    for (int signo : signals){
+        struct sigaction old_sa;
+        sigaction(signo, NULL, &old_sa);
+        if (old_sa.sa_handler != SIG_DFL) continue;
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = onSignal;
+        sa.sa_flags = SA_RESTART;  // system calls of the program carry on meanwhile
+        sigaction(signo, &sa, NULL);
+    }
+}
@@ -0,0 +1,33 @@
+/*
+    Buffered, asynchronous backend for the spec log lines (see log_spec.md).
+    LOG() formats into a per-thread ring buffer; a background thread drains
+    the rings to stdout in large write()s. Output is byte-identical to printf,
+    but lines reach stdout up to LOG_FLUSH_MILLISECONDS late. Everything still
+    buffered is written when the process exits normally (return from main /
+    exit()) or is stopped by SIGINT / SIGTERM, only SIGKILL loses it.
+*/
+
+#ifndef LOG_HEADER
+#define LOG_HEADER
+
+// per-thread ring buffer size, must be a power of 2
+#define LOG_RING_SIZE (1 << 20)
+
+// the flusher also wakes up on its own every LOG_FLUSH_MILLISECONDS msec
+#define LOG_FLUSH_MILLISECONDS 50
+
+extern bool log_enabled;
+
+// Start the background flusher. With enabled == false (--no-log) every LOG()
+// is a no-op, arguments are not even formatted. SIGINT / SIGTERM, unless the
+// program handles them itself, first flush and then terminate as before.
+void logInit(bool enabled);
+
+void logWrite(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+// Write everything buffered so far before returning
+void logFlush();
+
+#define LOG(...) do { if (log_enabled) logWrite(__VA_ARGS__); } while (0)
+
+#endif // LOG_HEADER
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ftw.h>
+#include <sys/stat.h>
+
+#include "manifest.h"
+
+using namespace std;
+
+bool isSafeName(const string &name){
+    if (name.empty() || name[0] == '/') return false;
+    size_t start = 0;
+    while (start <= name.size()){
+        size_t end = name.find('/', start);
+        if (end == string::npos) end = name.size();
+        string part = name.substr(start, end - start);
+        if (part.empty() || part == "." || part == "..") return false;
+        start = end + 1;
+    }
+    return name.find('\t') == string::npos && name.find('\n') == string::npos;
+}
+
+static vector<manifest_entry> walked;
+static size_t walk_root_len;
+
+static int walkFile(const char *path, const struct stat *st, int type, struct FTW *){
+    if (type == FTW_F && S_ISREG(st->st_mode)){
+        walked.push_back({(long long)st->st_size, string(path + walk_root_len)});
+    }
+    return 0;
+}
+
+vector<manifest_entry> listSourceFiles(const char *path, string *root){
+    struct stat st;
+    if (stat(path, &st) != 0){
+        perror("Error opening manifest");
+        exit(1);
+    }
+
+    vector<manifest_entry> entries;
+    if (S_ISDIR(st.st_mode)){
+        // every regular file below the directory, named relative to it
+        *root = path;
+        while (root->size() > 1 && root->back() == '/') root->pop_back();
+        walked.clear();
+        walk_root_len = root->size() + 1;
+        if (nftw(root->c_str(), walkFile, 64, FTW_PHYS) != 0){
+            perror("Error walking directory");
+            exit(1);
+        }
+        entries.swap(walked);
+        sort(entries.begin(), entries.end(),
+             [](const manifest_entry &a, const manifest_entry &b){ return a.name < b.name; });
+    }
+    else{
+        // a list of paths, relative to the current directory
+        *root = ".";
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL){
+            perror("Error opening manifest");
+            exit(1);
+        }
+        char line[4096];
+        while (fgets(line, sizeof(line), fp) != NULL){
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] == '\0') continue;
+            struct stat file_st;
+            if (stat(line, &file_st) != 0 || !S_ISREG(file_st.st_mode)){
+                fprintf(stderr, "Not a regular file: \"%s\"\n", line);
+                exit(1);
+            }
+            entries.push_back({(long long)file_st.st_size, string(line)});
+        }
+        fclose(fp);
+    }
+
+    for (const manifest_entry &entry : entries){
+        if (!isSafeName(entry.name)){
+            fprintf(stderr, "Cannot send \"%s\": only relative paths without \".\" / \"..\" are allowed\n",
+                    entry.name.c_str());
+            exit(1);
+        }
+    }
+    return entries;
+}
+
+string encodeManifest(const vector<manifest_entry> &entries){
+    string text;
+    for (const manifest_entry &entry : entries){
+        text += to_string(entry.size) + "\t" + entry.name + "\n";
+    }
+    return text;
+}
+
+bool decodeManifest(const string &text, vector<manifest_entry> *entries){
+    entries->clear();
+    size_t start = 0;
+    while (start < text.size()){
+        size_t end = text.find('\n', start);
+        if (end == string::npos) return false;
+        size_t tab = text.find('\t', start);
+        if (tab == string::npos || tab > end) return false;
+
+        manifest_entry entry;
+        char *size_end;
+        entry.size = strtoll(text.c_str() + start, &size_end, 10);
+        if (size_end != text.c_str() + tab || entry.size < 0) return false;
+        entry.name = text.substr(tab + 1, end - tab - 1);
+        if (!isSafeName(entry.name)) return false;
+        entries->push_back(entry);
+        start = end + 1;
+    }
+    return true;
+}
+
+bool readManifestTag(const char *data, int len, manifest_tag *tag){
+    if (len < (int)sizeof(*tag)) return false;
+    memcpy(tag, data, sizeof(*tag));
+    return tag->magic == MANIFEST_MAGIC;
+}
+
+void makeParentDirs(const string &dir, const string &name){
+    size_t slash = 0;
+    while ((slash = name.find('/', slash)) != string::npos){
+        string parent = dir + "/" + name.substr(0, slash);
+        if (mkdir(parent.c_str(), 0777) != 0 && errno != EEXIST){
+            perror("Error creating directory");
+            exit(1);
+        }
+        slash++;
+    }
+}
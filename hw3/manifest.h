@@ -0,0 +1,61 @@
+/*
+    Multi-file transfer (sender / receiver --manifest). Every file is split
+    into its own segments and all of them go out in one session. File 0 is
+    the manifest itself, one "<size>\t<relative path>\n" line per file, so
+    file i + 1 is the i-th line. It has the lowest sequence numbers, so the
+    receiver always has the whole manifest before the first byte of file 1
+    is delivered.
+
+    The spec header is left as it is: the data of a manifest segment starts
+    with a manifest_tag (covered by the checksum) naming the file and the
+    offset of the bytes that follow. Both ends must use --manifest. A
+    manifest receiver rejects data without a tag, but a plain receiver
+    cannot tell a manifest stream from a file and writes it, tags and all,
+    into its one output file.
+*/
+
+#ifndef MANIFEST_HEADER
+#define MANIFEST_HEADER
+
+#include <string>
+#include <vector>
+
+#include "def.h"
+
+#define MANIFEST_FILE_ID 0
+#define MANIFEST_MAGIC 0x544e464du  // "MFNT" in memory on little endian
+
+struct manifest_tag {
+    unsigned int magic;     // MANIFEST_MAGIC
+    int fileId;
+    int fileOffset;         // offset in the file of the data after the tag
+};
+
+// file bytes carried by one manifest segment
+#define MANIFEST_SEG_DATA (MAX_SEG_SIZE - (int)sizeof(struct manifest_tag))
+
+struct manifest_entry {
+    long long size;
+    std::string name;   // relative to the source / destination directory
+};
+
+// True if name is relative and has no "." / ".." / empty component,
+// i.e. it cannot escape the destination directory
+bool isSafeName(const std::string &name);
+
+// Entries of a manifest list file (one path per line) or, if path is a
+// directory, of every regular file below it (sorted). Exits on error.
+std::vector<manifest_entry> listSourceFiles(const char *path, std::string *root);
+
+std::string encodeManifest(const std::vector<manifest_entry> &entries);
+// Returns false if a line is malformed or a name is not safe
+bool decodeManifest(const std::string &text, std::vector<manifest_entry> *entries);
+
+// Read the tag in front of the len bytes of a segment's data; false if
+// there is none
+bool readManifestTag(const char *data, int len, manifest_tag *tag);
+
+// mkdir -p for the parent directories of dir/name
+void makeParentDirs(const std::string &dir, const std::string &name);
+
+#endif // MANIFEST_HEADER
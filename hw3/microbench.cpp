@@ -0,0 +1,254 @@
+/*
+    Micro-benchmarks for the protocol hot paths, no sockets involved.
+
+    Sender / receiver traces are recorded once per benchmark by running both
+    state machines against each other in memory, with the agent's loss model
+    (half of the errors dropped, half corrupted), then replayed event by event,
+    so the reported time is the cost of one ACK / one data segment.
+
+        $ make microbench && ./microbench --benchmark_filter=Trace
+*/
+
+#include <benchmark/benchmark.h>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+#include <zlib.h>
+#include <openssl/evp.h>
+
+#include "def.h"
+#include "sender_fsm.h"
+#include "receiver_fsm.h"
+#include "stats.h"
+#include "transport.h"
+
+using namespace std;
+
+#define TRACE_SEGMENTS 20000
+
+struct sender_event {
+    bool timeout;   // fire timeout() instead of delivering ack
+    segment ack;
+};
+
+// in-memory transport, segments are queued (while recording) or discarded (while replaying)
+class queue_transport : public transport {
+public:
+    deque<segment> *queue = NULL;
+    void send(segment *sgmt) override {
+        if (queue != NULL) queue->push_back(*sgmt);
+        benchmark::DoNotOptimize(sgmt);
+    }
+    bool recv(segment *, long long) override { return false; }
+    long long now() override { return statNowMicros(); }
+};
+
+static deque<segment> to_receiver, to_sender;
+static queue_transport sender_net, receiver_net;
+static vector<char> file_data;
+
+static void loadFile(int nsegs){
+    file_data.resize((size_t)nsegs * MAX_SEG_SIZE);
+    for (size_t i = 0; i < file_data.size(); i++) file_data[i] = (char)(i * 131 + 7);
+    sender_fsm::loadSegments(file_data.data(), file_data.size());
+}
+
+// Run sender and receiver against each other and record what each one receives
+static void buildTrace(int loss_permille, int thresh, int buf_size,
+                       vector<sender_event> *snd_trace, vector<segment> *rcv_trace){
+    mt19937 rng(318);
+    to_receiver.clear();
+    to_sender.clear();
+    sender_net.queue = &to_receiver;
+    receiver_net.queue = &to_sender;
+    sender_fsm::net = &sender_net;
+    receiver_fsm::net = &receiver_net;
+    receiver_fsm::deliver = NULL;
+
+    loadFile(TRACE_SEGMENTS);
+    sender_fsm::init_thresh = thresh;
+    sender_fsm::init();
+    receiver_fsm::init(buf_size);
+    while (!sender_fsm::isAllAcked()){
+        if (!to_receiver.empty()){
+            segment sgmt = to_receiver.front();
+            to_receiver.pop_front();
+            if ((int)(rng() % 1000) < loss_permille){
+                if (rng() % 2 == 0) continue;                   // drop
+                for (int i = 0; i < MAX_SEG_SIZE; i++) sgmt.data[i] = ~sgmt.data[i];  // corrupt
+            }
+            if (rcv_trace) rcv_trace->push_back(sgmt);
+            receiver_fsm::receiveDataPacket(&sgmt);
+        }
+        else if (!to_sender.empty()){
+            sender_event ev = {false, to_sender.front()};
+            to_sender.pop_front();
+            if (snd_trace) snd_trace->push_back(ev);
+            sender_fsm::handleAck(&ev.ack);
+        }
+        else{
+            // nothing in flight, only the retransmission timer can make progress
+            if (snd_trace) snd_trace->push_back({true, {}});
+            sender_fsm::timeout();
+        }
+    }
+    sender_net.queue = NULL;
+    receiver_net.queue = NULL;
+}
+
+static void resetSender(int thresh){
+    sender_fsm::loadSegments(file_data.data(), file_data.size());
+    sender_fsm::init_thresh = thresh;
+    sender_fsm::init();
+}
+
+// One iteration = one ACK (or timeout) through handleAck, including transmitNew
+static void BM_SenderAckTrace(benchmark::State &state){
+    int loss = state.range(0), thresh = state.range(1);
+    vector<sender_event> trace;
+    buildTrace(loss, thresh, MAX_SEG_BUF_SIZE, &trace, NULL);
+    resetSender(thresh);
+
+    size_t i = 0;
+    for (auto _ : state){
+        if (i == trace.size()){
+            state.PauseTiming();
+            resetSender(thresh);
+            i = 0;
+            state.ResumeTiming();
+        }
+        sender_event *ev = &trace[i++];
+        if (ev->timeout) sender_fsm::timeout();
+        else sender_fsm::handleAck(&ev->ack);
+    }
+    state.counters["final_cwnd"] = sender_fsm::cwnd;
+}
+BENCHMARK(BM_SenderAckTrace)->ArgsProduct({{0, 10, 100, 200}, {16, 256}})->ArgNames({"loss_permille", "thresh"});
+
+// markSACK + updateBase only, on the ACKs of the same trace
+static void BM_SenderMarkSACKUpdateBase(benchmark::State &state){
+    int loss = state.range(0);
+    vector<sender_event> trace;
+    buildTrace(loss, INIT_THRESH, MAX_SEG_BUF_SIZE, &trace, NULL);
+    resetSender(INIT_THRESH);
+
+    size_t i = 0;
+    for (auto _ : state){
+        if (i == trace.size()){
+            state.PauseTiming();
+            resetSender(INIT_THRESH);
+            i = 0;
+            state.ResumeTiming();
+        }
+        sender_event *ev = &trace[i++];
+        if (ev->timeout) continue;
+        sender_fsm::markSACK(ev->ack.head.sackNumber);
+        if (ev->ack.head.ackNumber >= sender_fsm::base) sender_fsm::updateBase(ev->ack.head.ackNumber);
+    }
+}
+BENCHMARK(BM_SenderMarkSACKUpdateBase)->Arg(0)->Arg(100)->Arg(200)->ArgName("loss_permille");
+
+// transmitNew walks the window from base, so its cost grows with cwnd
+static void BM_TransmitNew(benchmark::State &state){
+    loadFile(TRACE_SEGMENTS);
+    sender_net.queue = NULL;
+    sender_fsm::net = &sender_net;
+    sender_fsm::base = 1;
+    sender_fsm::cwnd = state.range(0);
+    sender_fsm::max_send_seq_num = TRACE_SEGMENTS; // everything counts as a resend, no first-send bookkeeping
+    for (auto _ : state){
+        sender_fsm::transmitNew(1);
+    }
+}
+BENCHMARK(BM_TransmitNew)->RangeMultiplier(4)->Range(1, 4096)->ArgName("cwnd");
+
+// One iteration = one data segment through receiveDataPacket (checksum, buffer, ACK, flush)
+static void BM_ReceiverTrace(benchmark::State &state){
+    int loss = state.range(0), buf_size = state.range(1);
+    vector<segment> trace;
+    buildTrace(loss, INIT_THRESH, buf_size, NULL, &trace);
+    receiver_fsm::init(buf_size);
+
+    size_t i = 0;
+    for (auto _ : state){
+        if (i == trace.size()){
+            state.PauseTiming();
+            receiver_fsm::init(buf_size);
+            i = 0;
+            state.ResumeTiming();
+        }
+        receiver_fsm::receiveDataPacket(&trace[i++]);
+    }
+}
+BENCHMARK(BM_ReceiverTrace)->ArgsProduct({{0, 100, 200}, {64, 256, 1024}})->ArgNames({"loss_permille", "buf_size"});
+
+static void fillBuffer(int count){
+    segment sgmt;
+    memset(&sgmt, 0, sizeof(sgmt));
+    sgmt.head.length = MAX_SEG_SIZE;
+    for (int i = 1; i <= count; i++){
+        sgmt.head.seqNumber = i;
+        receiver_fsm::markSACK(&sgmt);
+    }
+}
+
+// Worst case: every slot but the last is filled
+static void BM_IsBufferFull(benchmark::State &state){
+    int buf_size = state.range(0);
+    receiver_fsm::init(buf_size);
+    fillBuffer(buf_size - 1);
+    for (auto _ : state){
+        benchmark::DoNotOptimize(receiver_fsm::isBufferFull());
+    }
+}
+BENCHMARK(BM_IsBufferFull)->Arg(64)->Arg(256)->Arg(1024)->ArgName("buf_size");
+
+// Deliver a full buffer and hash it (the sha256 log line itself is BM_SHA256Report)
+static void BM_Flush(benchmark::State &state){
+    int buf_size = state.range(0);
+    receiver_fsm::net = &receiver_net;
+    receiver_fsm::init(buf_size);
+    for (auto _ : state){
+        state.PauseTiming();
+        fillBuffer(buf_size);
+        state.ResumeTiming();
+        receiver_fsm::flush();
+    }
+    state.SetBytesProcessed(state.iterations() * buf_size * MAX_SEG_SIZE);
+}
+BENCHMARK(BM_Flush)->Arg(64)->Arg(256)->Arg(1024)->ArgName("buf_size");
+
+static void BM_CRC32(benchmark::State &state){
+    char data[MAX_SEG_SIZE];
+    memset(data, 'a', sizeof(data));
+    for (auto _ : state){
+        benchmark::DoNotOptimize(crc32(0L, (const Bytef *)data, MAX_SEG_SIZE));
+    }
+    state.SetBytesProcessed(state.iterations() * MAX_SEG_SIZE);
+}
+BENCHMARK(BM_CRC32);
+
+static void BM_SHA256Update(benchmark::State &state){
+    vector<char> data(state.range(0), 'a');
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    for (auto _ : state){
+        EVP_DigestUpdate(ctx, data.data(), data.size());
+    }
+    EVP_MD_CTX_free(ctx);
+    state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_SHA256Update)->Arg(MAX_SEG_SIZE)->Arg(MAX_SEG_SIZE * MAX_SEG_BUF_SIZE)->ArgName("bytes");
+
+// The per-flush "sha256" log line: copy the running context and finalize the copy
+static void BM_SHA256Report(benchmark::State &state){
+    receiver_fsm::init(MAX_SEG_BUF_SIZE);
+    char hex[EVP_MAX_MD_SIZE * 2 + 1];
+    for (auto _ : state){
+        receiver_fsm::sha256Hex(hex);
+    }
+}
+BENCHMARK(BM_SHA256Report);
+
+BENCHMARK_MAIN();
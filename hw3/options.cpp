@@ -0,0 +1,67 @@
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "options.h"
+
+// The whole argument must be a number in [min, INT_MAX]
+static bool parseInt(const char *flag, const char *arg, int min, int *value){
+    char *end;
+    errno = 0;
+    long v = strtol(arg, &end, 10);
+    if (end == arg || *end != '\0' || errno == ERANGE || v < min || v > INT_MAX){
+        fprintf(stderr, "Option %s needs an integer >= %d, not \"%s\"\n", flag, min, arg);
+        return false;
+    }
+    *value = (int)v;
+    return true;
+}
+
+int parseOptions(int argc, char *argv[], int first, int allowed, struct options *opt){
+    memset(opt, 0, sizeof(*opt));
+    for (int i = first; i < argc; i++){
+        const char *flag = argv[i];
+        int kind = 0;
+        bool ok = true;
+        if (strcmp(flag, "--stats") == 0 && i + 1 < argc){
+            kind = OPT_STATS;
+            opt->stats_path = argv[++i];
+        }
+        else if (strcmp(flag, "--stats-interval") == 0 && i + 1 < argc){
+            kind = OPT_STATS;
+            ok = parseInt(flag, argv[++i], 0, &opt->stats_interval_ms);
+        }
+        else if (strcmp(flag, "--thresh") == 0 && i + 1 < argc){
+            kind = OPT_THRESH;
+            ok = parseInt(flag, argv[++i], 1, &opt->thresh);
+        }
+        else if (strcmp(flag, "--no-log") == 0){
+            kind = OPT_NO_LOG;
+            opt->no_log = true;
+        }
+        else if (strcmp(flag, "--manifest") == 0){
+            kind = OPT_MANIFEST;
+            opt->manifest = true;
+        }
+        else if (strcmp(flag, "--offload") == 0){
+            kind = OPT_OFFLOAD;
+            opt->offload = true;
+        }
+        else if (strcmp(flag, "--uring") == 0){
+            kind = OPT_URING;
+            opt->uring = true;
+        }
+        else{
+            fprintf(stderr, "Unknown or incomplete option \"%s\"\n", flag);
+            return -1;
+        }
+        if (!ok) return -1;
+        if ((allowed & kind) == 0){
+            fprintf(stderr, "Option %s does not apply to %s\n", flag, argv[0]);
+            return -1;
+        }
+    }
+    return 0;
+}
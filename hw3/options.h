@@ -0,0 +1,42 @@
+/*
+    Optional command line flags shared by sender, receiver and agent.
+    They come after the positional arguments required by the spec, e.g.
+        ./sender local 8887 local 8888 1MBFile --stats sender_stats.json
+*/
+
+#ifndef OPTIONS_HEADER
+#define OPTIONS_HEADER
+
+struct options {
+    const char *stats_path;     // --stats <path>: JSON report at exit ("-" is stderr)
+    int stats_interval_ms;      // --stats-interval <ms>: also report periodically
+    bool no_log;                // --no-log: suppress the spec log lines on stdout
+    int thresh;                 // --thresh <n>: sender's initial threshold, >= 1 (0 means the default)
+    bool manifest;              // --manifest: multi-file transfer, see manifest.h
+    bool offload;               // --offload: UDP GSO for sending, UDP GRO for receiving
+    bool uring;                 // --uring: receiver does socket and file I/O through io_uring
+};
+
+// which flags a binary accepts, for parseOptions()
+#define OPT_STATS       0x01    // --stats, --stats-interval
+#define OPT_NO_LOG      0x02
+#define OPT_THRESH      0x04
+#define OPT_MANIFEST    0x08
+#define OPT_OFFLOAD     0x10
+#define OPT_URING       0x20
+
+#define SENDER_OPTIONS      (OPT_STATS | OPT_NO_LOG | OPT_THRESH | OPT_MANIFEST | OPT_OFFLOAD)
+#define RECEIVER_OPTIONS    (OPT_STATS | OPT_NO_LOG | OPT_MANIFEST | OPT_OFFLOAD | OPT_URING)
+#define AGENT_OPTIONS       (OPT_STATS | OPT_NO_LOG | OPT_OFFLOAD)
+
+#define COMMON_USAGE "[--stats <path>] [--stats-interval <ms>] [--no-log] [--offload]"
+#define SENDER_USAGE COMMON_USAGE " [--thresh <n>] [--manifest]"
+#define RECEIVER_USAGE COMMON_USAGE " [--manifest] [--uring]"
+#define AGENT_USAGE COMMON_USAGE
+
+// Parse argv[first..argc) into opt, allowing only the flags in `allowed`.
+// Returns 0 on success, -1 on unknown, not allowed or incomplete flags and
+// on bad numbers (after printing the reason to stderr).
+int parseOptions(int argc, char *argv[], int first, int allowed, struct options *opt);
+
+#endif // OPTIONS_HEADER
@@ -8,29 +8,46 @@
 #include <cstring>
 #include <stdio.h>
 #include <stdbool.h>
-#include <zlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
-#include <openssl/evp.h>
 #include <string>
 #include <sstream>
 #include <iomanip>
 #include <string.h>
+#include <vector>
+#include <cerrno>
 
 #include "def.h"
+#include "manifest.h"
+#include "receiver_fsm.h"
+#include "transport.h"
+#include "uring.h"
+#include "stats.h"
+#include "options.h"
+#include "log.h"
 
 using namespace std;
+using namespace receiver_fsm;
 #define FILESIZE 10240000 //10 MB
 
-segment *buffer[MAX_SEG_BUF_SIZE];
-char file_arr[FILESIZE];
-int file_copy_offset = 0;
-int base;
-int flush_count; //count how many times the buffer has been flushed
-int file_size = 0;
-bool endflag;
-int fd;
+char file_buf[FILESIZE];
+char *file_arr = file_buf;  // data waiting to be written
+int file_arr_size = FILESIZE;
+int file_copy_offset = 0;   // bytes in file_arr
+long long arr_file_offset = 0; // where file_arr[0] goes in the current file
+int fd = -1;
+
+// --manifest: <dst_filepath> is a directory, see manifest.h
+bool manifest_mode = false;
+string dst_dir;
+string manifest_text;
+vector<manifest_entry> entries;
+bool files_created = false;
+int cur_file = MANIFEST_FILE_ID;
+
+// --uring: file_arr is one flush worth of data, handed to the ring when full
+uring_transport *uring = NULL;
 
 void setIP(char *dst, char *src){
     if(strcmp(src, "0.0.0.0") == 0 || strcmp(src, "local") == 0 || strcmp(src, "localhost") == 0){
@@ -42,169 +59,118 @@ void setIP(char *dst, char *src){
     return;
 }
 
-char *hexDigest(const void *buf, int len) {
-    const unsigned char *cbuf = (const unsigned char *)buf;
-    char *hx = (char *) malloc(len * 2 + 1); // Each byte requires 2 characters, plus 1 for null terminator
-
-    for (int i = 0; i < len; ++i)
-        sprintf(hx + i * 2, "%02x", cbuf[i]);
-
-    return hx;
-}
-
-char *printSHA256(){
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hash_len;
-
-    EVP_MD_CTX *sha256 = EVP_MD_CTX_new();
-    EVP_DigestInit_ex(sha256, EVP_sha256(), NULL);
-
-    // Process the entire string
-    EVP_DigestUpdate(sha256, file_arr, file_copy_offset); // Exclude null terminator
-
-    // Calculate the final hash
-    EVP_DigestFinal_ex(sha256, hash, &hash_len);
-    return hexDigest(hash, hash_len);
-}
-
-// Flush buffer and deliver to application (i.e. hash and store)
-void flush(){
-    for (int i = 0; i < MAX_SEG_BUF_SIZE; i++){
-        if (buffer[i] != NULL){
-            memcpy(file_arr + file_copy_offset, buffer[i]->data, buffer[i]->head.length);
-            file_copy_offset += buffer[i]->head.length;
-        }
-        buffer[i] = NULL;
+// A buffer for the next flush under --uring (the last one is still being
+// written), allocated only once there is data for it
+char *newChunk(){
+    char *chunk = (char *) malloc(file_arr_size);
+    if (chunk == NULL){
+        perror("Error allocating write buffer");
+        exit(1);
     }
-    flush_count++;
-    base = 1;
-    printf("flush\n");
-    cout << "sha256\t" << file_copy_offset << "\t" << printSHA256() << endl;
-}
-
-// True if every packet (i.e. packet before AND INCLUDING fin) is received.
-// This actually should happen when you receive FIN, no matter what.
-int isAllReceived(segment *segment, int sock_fd, struct sockaddr_in recv_addr){
-    if (segment->head.fin == 1){
-        printf("recv\tfin\n");
-        segment->head.ack = 1;
-        sendto(sock_fd, segment, sizeof(*segment), 0, (struct sockaddr *)&recv_addr, sizeof(sockaddr));
-        printf("send\tfinack\n");
-        endflag = true;
-        return true;
-    }
-    return false;
+    return chunk;
 }
 
-void endReceive(int sock_fd, struct sockaddr_in recv_addr){
-    cout << "finsha\t" << printSHA256() << endl;
-    //printf("content = %s", file_arr);
-    write(fd, file_arr, file_copy_offset);
-}
-
-bool isBufferFull(){
-    for (int i = 0; i < MAX_SEG_BUF_SIZE; i++){
-        if (buffer[i] == NULL) return false;
+void writeOut(){
+    if (file_copy_offset == 0) return;
+    if (uring != NULL){
+        // written in the background, carry on in a new buffer
+        uring->write(fd, file_arr, file_copy_offset, arr_file_offset);
+        file_arr = NULL;
     }
-    return true;
-}
-
-bool isCorrupt(segment *recv_segment){
-    if (recv_segment->head.fin == 1) return false;
-
-    unsigned long checksum = crc32(0L, (const Bytef *)recv_segment->data, MAX_SEG_SIZE);
-    if (checksum != recv_segment->head.checksum) return true;
-    return false;
-}
-
-void sendSACK(int ack_seq_num, int sack_seq_num, bool is_fin, int sock_fd, struct sockaddr_in recv_addr){
-    segment *ack_segment = (segment *) malloc(sizeof(segment));
-    ack_segment->head.ackNumber = ack_seq_num;
-    ack_segment->head.sackNumber = sack_seq_num;
-    ack_segment->head.fin = false;
-    ack_segment->head.ack = 1;
-    sendto(sock_fd, ack_segment, sizeof(*ack_segment), 0, (struct sockaddr *)&recv_addr, sizeof(sockaddr));
-    printf("send\tack\t#%d,\tsack\t#%d\n", ack_seq_num, sack_seq_num);
-}
-
-// Mark and put segment with sequence number seq_num in buffer
-void markSACK(segment *segment){
-    buffer[(segment->head.seqNumber - 1) % MAX_SEG_BUF_SIZE] = segment;
+    else{
+        pwrite(fd, file_arr, file_copy_offset, arr_file_offset);
+        statInc(STAT_SYS_WRITE);
+    }
+    arr_file_offset += file_copy_offset;
+    file_copy_offset = 0;
 }
 
-// Update base and buffer s.t. base is the first unsacked packet
-void updateBase(){
-    // base means cumulative ACK here
-    for (int i = base + 1; i <= MAX_SEG_BUF_SIZE; i++){
-        if (buffer[i-1] == NULL){
-            base = i;
-            return;
+// Once the manifest is complete: create every file it lists (empty files
+// have no segments, so this is the only time they are touched)
+void createFiles(){
+    if (!decodeManifest(manifest_text, &entries)){
+        fprintf(stderr, "Malformed manifest\n");
+        exit(1);
+    }
+    for (const manifest_entry &entry : entries){
+        makeParentDirs(dst_dir, entry.name);
+        int file_fd = open((dst_dir + "/" + entry.name).c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0777);
+        if (file_fd < 0){
+            perror(entry.name.c_str());
+            exit(1);
         }
+        close(file_fd);
     }
-    
-    // if did not return above, that means after receiving this segment, buffer is full
-    base = MAX_SEG_BUF_SIZE + 1;
-    return;
+    files_created = true;
 }
 
-// True if the sequence number is above buffer range
-// e.g. if the buffer stores sequence number in range [1, 257) and receives
-// a segment with seqNumber 257 (or above 257), return True
-bool isOverBuffer(int seq_num){
-    if (seq_num > MAX_SEG_BUF_SIZE * (flush_count + 1)) return true;
-    return false;
+void switchFile(int file_id){
+    writeOut();
+    if (fd >= 0) close(fd);
+    string path = dst_dir + "/" + entries[file_id - MANIFEST_FILE_ID - 1].name;
+    fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0){
+        perror(path.c_str());
+        exit(1);
+    }
+    cur_file = file_id;
+    arr_file_offset = 0;
 }
 
-void receiveDataPacket(segment *segment, int sock_fd, struct sockaddr_in recv_addr){
-    if (isCorrupt(segment)){
-        //corrupted segments
-        printf("drop\tdata\t#%d\t(corrupted)\n", segment->head.seqNumber);
-        sendSACK(MAX_SEG_BUF_SIZE * flush_count + base - 1, MAX_SEG_BUF_SIZE * flush_count + base - 1, false, sock_fd, recv_addr);
-    }
-    else if (segment->head.seqNumber == (MAX_SEG_BUF_SIZE * flush_count + base)){
-        //in order segments
-        updateBase(); // important: update base first
-        //not fin segments
-        if (segment->head.fin == 0){
-            printf("recv\tdata\t#%d\t(in order)\n", segment->head.seqNumber);
-            markSACK(segment);
-            // base - 1 because update base first
-            sendSACK(MAX_SEG_BUF_SIZE * flush_count + base - 1, segment->head.seqNumber, segment->head.fin, sock_fd, recv_addr);
+// the application: keep the data in memory, written out when file_arr is
+// full, when the file changes and at the end
+void storeData(const char *data, int len){
+    manifest_tag tag;
+    int file_offset;
+    if (manifest_mode){
+        if (!readManifestTag(data, len, &tag)){
+            fprintf(stderr, "Segment without a manifest tag, is the sender running with --manifest?\n");
+            exit(1);
+        }
+        data += sizeof(tag), len -= sizeof(tag);
+        if (tag.fileId == MANIFEST_FILE_ID){
+            manifest_text.append(data, len);
+            return;
         }
-        
-        if (isAllReceived(segment, sock_fd, recv_addr)){
-            flush();
-            endReceive(sock_fd, recv_addr);
+        if (!files_created) createFiles();
+        // the tag is checksummed, but still comes from the network
+        if (tag.fileId < MANIFEST_FILE_ID + 1 || tag.fileId - MANIFEST_FILE_ID - 1 >= (int)entries.size()){
+            fprintf(stderr, "Segment of unknown file %d\n", tag.fileId);
+            exit(1);
         }
-        else if (isBufferFull()){
-            flush();
+        if (tag.fileOffset < 0 || (long long)tag.fileOffset + len > entries[tag.fileId - MANIFEST_FILE_ID - 1].size){
+            fprintf(stderr, "Segment beyond the end of file %d\n", tag.fileId);
+            exit(1);
         }
+        if (tag.fileId != cur_file) switchFile(tag.fileId);
+        file_offset = tag.fileOffset;
     }
     else{
-        //Out of order
-        if (isOverBuffer(segment->head.seqNumber)){
-            // out of buffer range (buffer_end), drop
-            // (still send sack, but effectively only cumulative ack)
-            printf("drop\tdata\t#%d\t(buffer overflow)\n", segment->head.seqNumber); 
-            sendSACK(MAX_SEG_BUF_SIZE * flush_count + base - 1, MAX_SEG_BUF_SIZE * flush_count + base - 1, false, sock_fd, recv_addr);
-        }
-        else{
-            // out of order sack or under buffer range
-            // just do sack the normal way
-            printf("recv\tdata\t#%d\t(out of order, sack-ed)\n", segment->head.seqNumber); 
-            markSACK(segment);
-            sendSACK(MAX_SEG_BUF_SIZE * flush_count + base - 1, segment->head.seqNumber, segment->head.fin, sock_fd, recv_addr);
-        }
+        // segments are delivered in order and back to back; the data is
+        // never looked at, any file (even one that starts like a tag) is valid
+        file_offset = arr_file_offset + file_copy_offset;
+    }
+    // not contiguous with what is in file_arr, or no room left
+    if (file_offset != arr_file_offset + file_copy_offset || file_copy_offset + len > file_arr_size){
+        writeOut();
+        arr_file_offset = file_offset;
     }
+    if (file_arr == NULL) file_arr = newChunk();
+    memcpy(file_arr + file_copy_offset, data, len);
+    file_copy_offset += len;
 }
 
 // ./receiver <recv_ip> <recv_port> <agent_ip> <agent_port> <dst_filepath>
+// with --manifest, <dst_filepath> is the directory the files are written to
 int main(int argc, char *argv[]) {
     // parse arguments
-    if (argc != 6) {
-        cerr << "Usage: " << argv[0] << " <recv_ip> <recv_port> <agent_ip> <agent_port> <dst_filepath>" << endl;
+    struct options opt;
+    if (argc < 6 || parseOptions(argc, argv, 6, RECEIVER_OPTIONS, &opt) != 0) {
+        cerr << "Usage: " << argv[0] << " <recv_ip> <recv_port> <agent_ip> <agent_port> <dst_filepath> " RECEIVER_USAGE << endl;
         exit(1);
     }
+    statInit("receiver", opt.stats_path, opt.stats_interval_ms);
+    logInit(!opt.no_log);
 
     int recv_port, agent_port;
     char recv_ip[50], agent_ip[50];
@@ -217,8 +183,18 @@ int main(int argc, char *argv[]) {
     sscanf(argv[4], "%d", &agent_port);
 
     char *filepath = argv[5];
-    unlink(filepath); // delete file first if it exists
-    fd = open(filepath, O_CREAT | O_WRONLY | O_TRUNC, 0777);
+    if (opt.manifest){
+        manifest_mode = true;
+        dst_dir = filepath;
+        if (mkdir(filepath, 0777) != 0 && errno != EEXIST){
+            perror("Error creating directory");
+            exit(1);
+        }
+    }
+    else{
+        unlink(filepath); // delete file first if it exists
+        fd = open(filepath, O_CREAT | O_WRONLY | O_TRUNC, 0777);
+    }
 
     // make socket related stuff
     int sock_fd = socket(PF_INET, SOCK_DGRAM, 0);
@@ -235,15 +211,30 @@ int main(int argc, char *argv[]) {
     memset(addr.sin_zero, '\0', sizeof(addr.sin_zero));    
     bind(sock_fd, (struct sockaddr *)&addr, sizeof(addr));
 
-    memset(file_arr, 0, sizeof(file_arr));
-
-    base = 1;
-    flush_count = 0; //at the beginning, buffer has range [1, MAX_SEG_BUF_SIZE]
-    endflag = false;
-    socklen_t recv_addr_sz;
-    while (endflag == false){
-        segment *recv_segment = (segment *) malloc(sizeof(segment));
-        recvfrom(sock_fd, recv_segment, sizeof(*recv_segment), 0, (struct sockaddr *)&recv_addr, &recv_addr_sz);
-        receiveDataPacket(recv_segment, sock_fd, recv_addr);
+    init(MAX_SEG_BUF_SIZE);
+    uring_transport ring(sock_fd, recv_addr);
+    if (opt.uring){
+        if (ring.init()){
+            uring = &ring;
+            file_arr_size = MAX_SEG_BUF_SIZE * MAX_SEG_SIZE;
+            file_arr = NULL;
+        }
+        else{
+            fprintf(stderr, "io_uring unavailable, using recvfrom / write\n");
+        }
+    }
+    if (uring == NULL) memset(file_buf, 0, sizeof(file_buf));
+    // no GRO with the ring: its buffers hold one datagram each
+    udp_transport udp(sock_fd, recv_addr, opt.offload && uring == NULL);
+    net = uring != NULL ? (transport *)&ring : &udp;
+    deliver = storeData;
+    run();
+
+    if (manifest_mode && !files_created) createFiles();
+    writeOut();
+    if (uring != NULL){
+        uring->drain();
+        free(file_arr);     // NULL unless a chunk was started but got no data
     }
+    if (fd >= 0) close(fd);
 }
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+#include <openssl/evp.h>
+
+#include "receiver_fsm.h"
+#include "stats.h"
+#include "log.h"
+
+namespace receiver_fsm {
+
+segment *buffer;
+bool *buffered;
+int seg_buf_size;
+int base;
+int flush_count;
+long long delivered_bytes;
+bool endflag;
+
+transport *net;
+void (*deliver)(const char *data, int len);
+
+// running hash of the delivered bytes, so each flush only hashes the new data
+static EVP_MD_CTX *sha256;
+
+void init(int buf_size){
+    seg_buf_size = buf_size;
+    free(buffer);
+    free(buffered);
+    buffer = (segment *) malloc(sizeof(segment) * seg_buf_size);
+    buffered = (bool *) calloc(seg_buf_size, sizeof(bool));
+    base = 1;
+    flush_count = 0; //at the beginning, buffer has range [1, seg_buf_size]
+    delivered_bytes = 0;
+    endflag = false;
+
+    if (sha256 == NULL) sha256 = EVP_MD_CTX_new();
+    EVP_DigestInit_ex(sha256, EVP_sha256(), NULL);
+}
+
+void sha256Hex(char *out){
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hash_len;
+
+    // finalize a copy, the running context keeps accepting data
+    EVP_MD_CTX *copy = EVP_MD_CTX_new();
+    EVP_MD_CTX_copy_ex(copy, sha256);
+    EVP_DigestFinal_ex(copy, hash, &hash_len);
+    EVP_MD_CTX_free(copy);
+
+    for (unsigned int i = 0; i < hash_len; ++i)
+        sprintf(out + i * 2, "%02x", hash[i]);
+}
+
+// Flush buffer and deliver to application (i.e. hash and store)
+void flush(){
+    for (int i = 0; i < seg_buf_size; i++){
+        if (buffered[i]){
+            EVP_DigestUpdate(sha256, buffer[i].data, buffer[i].head.length);
+            if (deliver != NULL) deliver(buffer[i].data, buffer[i].head.length);
+            delivered_bytes += buffer[i].head.length;
+            statInc(STAT_GOODPUT_BYTES, buffer[i].head.length);
+        }
+        buffered[i] = false;
+    }
+    flush_count++;
+    statInc(STAT_FLUSH);
+    base = 1;
+    LOG("flush\n");
+    if (log_enabled){
+        char hex[EVP_MAX_MD_SIZE * 2 + 1];
+        sha256Hex(hex);
+        LOG("sha256\t%lld\t%s\n", delivered_bytes, hex);
+    }
+}
+
+// True if every packet (i.e. packet before AND INCLUDING fin) is received.
+// This actually should happen when you receive FIN, no matter what.
+int isAllReceived(segment *segment){
+    if (segment->head.fin == 1){
+        LOG("recv\tfin\n");
+        segment->head.ack = 1;
+        net->send(segment);
+        LOG("send\tfinack\n");
+        endflag = true;
+        return true;
+    }
+    return false;
+}
+
+void endReceive(){
+    if (log_enabled){
+        char hex[EVP_MAX_MD_SIZE * 2 + 1];
+        sha256Hex(hex);
+        LOG("finsha\t%s\n", hex);
+    }
+}
+
+bool isBufferFull(){
+    for (int i = 0; i < seg_buf_size; i++){
+        if (!buffered[i]) return false;
+    }
+    return true;
+}
+
+bool isCorrupt(segment *recv_segment){
+    if (recv_segment->head.fin == 1) return false;
+
+    unsigned long checksum = crc32(0L, (const Bytef *)recv_segment->data, MAX_SEG_SIZE);
+    if (checksum != recv_segment->head.checksum) return true;
+    return false;
+}
+
+void sendSACK(int ack_seq_num, int sack_seq_num){
+    segment ack_segment;
+    memset(&ack_segment.head, 0, sizeof(ack_segment.head));
+    ack_segment.head.ackNumber = ack_seq_num;
+    ack_segment.head.sackNumber = sack_seq_num;
+    ack_segment.head.fin = false;
+    ack_segment.head.ack = 1;
+    net->send(&ack_segment);
+    LOG("send\tack\t#%d,\tsack\t#%d\n", ack_seq_num, sack_seq_num);
+    statInc(STAT_ACK_SENT);
+}
+
+// Mark and put segment with sequence number seq_num in buffer
+void markSACK(segment *segment){
+    int slot = (segment->head.seqNumber - 1) % seg_buf_size;
+    memcpy(&buffer[slot], segment, sizeof(*segment));
+    buffered[slot] = true;
+}
+
+// Update base and buffer s.t. base is the first unsacked packet
+void updateBase(){
+    // base means cumulative ACK here
+    for (int i = base + 1; i <= seg_buf_size; i++){
+        if (!buffered[i-1]){
+            base = i;
+            return;
+        }
+    }
+
+    // if did not return above, that means after receiving this segment, buffer is full
+    base = seg_buf_size + 1;
+    return;
+}
+
+// True if the sequence number is above buffer range
+// e.g. if the buffer stores sequence number in range [1, 257) and receives
+// a segment with seqNumber 257 (or above 257), return True
+bool isOverBuffer(int seq_num){
+    if (seq_num > seg_buf_size * (flush_count + 1)) return true;
+    return false;
+}
+
+void receiveDataPacket(segment *segment){
+    if (isCorrupt(segment)){
+        //corrupted segments
+        LOG("drop\tdata\t#%d\t(corrupted)\n", segment->head.seqNumber);
+        statInc(STAT_DATA_CORRUPTED);
+        sendSACK(seg_buf_size * flush_count + base - 1, seg_buf_size * flush_count + base - 1);
+    }
+    else if (segment->head.seqNumber == (seg_buf_size * flush_count + base)){
+        //in order segments
+        updateBase(); // important: update base first
+        //not fin segments
+        if (segment->head.fin == 0){
+            LOG("recv\tdata\t#%d\t(in order)\n", segment->head.seqNumber);
+            statInc(STAT_DATA_RECV);
+            markSACK(segment);
+            // base - 1 because update base first
+            sendSACK(seg_buf_size * flush_count + base - 1, segment->head.seqNumber);
+        }
+
+        if (isAllReceived(segment)){
+            flush();
+            endReceive();
+        }
+        else if (isBufferFull()){
+            flush();
+        }
+    }
+    else{
+        //Out of order
+        if (isOverBuffer(segment->head.seqNumber)){
+            // out of buffer range (buffer_end), drop
+            // (still send sack, but effectively only cumulative ack)
+            LOG("drop\tdata\t#%d\t(buffer overflow)\n", segment->head.seqNumber);
+            statInc(STAT_DATA_DROPPED);
+            sendSACK(seg_buf_size * flush_count + base - 1, seg_buf_size * flush_count + base - 1);
+        }
+        else{
+            // out of order sack or under buffer range
+            // just do sack the normal way
+            LOG("recv\tdata\t#%d\t(out of order, sack-ed)\n", segment->head.seqNumber);
+            statInc(STAT_DATA_RECV);
+            markSACK(segment);
+            sendSACK(seg_buf_size * flush_count + base - 1, segment->head.seqNumber);
+        }
+    }
+}
+
+void run(){
+    segment recv_segment;
+    while (endflag == false){
+        net->recv(&recv_segment, -1);
+        receiveDataPacket(&recv_segment);
+    }
+}
+
+} // namespace receiver_fsm
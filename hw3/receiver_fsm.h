@@ -0,0 +1,51 @@
+/*
+    Receiver state machine (see fsm.py), independent of sockets and files.
+    ACKs go out through `net` and flushed data is handed to `deliver`; every
+    received segment is fed to receiveDataPacket(), either by run() or by
+    whoever drives the FSM in-process (simulator, benchmarks).
+*/
+
+#ifndef RECEIVER_FSM_HEADER
+#define RECEIVER_FSM_HEADER
+
+#include "def.h"
+#include "transport.h"
+
+namespace receiver_fsm {
+
+extern segment *buffer;     // seg_buf_size slots, segment seqNumber goes to slot (seqNumber - 1) % seg_buf_size
+extern bool *buffered;      // buffered[i] is true if slot i holds a segment
+extern int seg_buf_size;
+extern int base;
+extern int flush_count;     //count how many times the buffer has been flushed
+extern long long delivered_bytes;
+extern bool endflag;
+
+// where ACK / FINACK segments go out, must be set before receiving
+extern transport *net;
+// where flushed data goes (the "application"), in order, may be NULL
+extern void (*deliver)(const char *data, int len);
+
+// Reset the FSM with a buffer of buf_size segments (MAX_SEG_BUF_SIZE in the spec)
+void init(int buf_size);
+
+// Hex sha256 of everything delivered so far, out must hold 65 bytes
+void sha256Hex(char *out);
+
+void flush();
+int isAllReceived(segment *segment);
+void endReceive();
+bool isBufferFull();
+bool isCorrupt(segment *recv_segment);
+void sendSACK(int ack_seq_num, int sack_seq_num);
+void markSACK(segment *segment);
+void updateBase();
+bool isOverBuffer(int seq_num);
+void receiveDataPacket(segment *segment);
+
+// Receive from `net` until FIN
+void run();
+
+} // namespace receiver_fsm
+
+#endif // RECEIVER_FSM_HEADER
@@ -0,0 +1,294 @@
+#include <cstdlib>
+#include <cstring>
+#include <zlib.h>
+
+#include "sender_fsm.h"
+#include "manifest.h"
+#include "stats.h"
+#include "log.h"
+
+#define MAX(x, y) (x > y ? x : y)
+#define SEND_BATCH 64 // segments handed to net->sendBatch() at once
+
+namespace sender_fsm {
+
+segment *transmit_queue;
+int total_segments;
+static int queue_capacity;
+int max_send_seq_num = 0; // current max send sequence number, so we can tell if it is resend or not
+int successfully_sent = 0; // number of segments successfully sent, to check if all are sent or not
+long long send_time_us[MAX_SEGMENTS]; // first transmission time of each segment, for RTT samples
+bool retransmitted[MAX_SEGMENTS]; // Karn's rule: no RTT sample from retransmitted segments
+long long deadline; // retransmission timer expires at this net->now()
+
+double cwnd;
+int thresh, dup_ack;
+int init_thresh = INIT_THRESH;
+int state;
+int base;
+
+long long timeout_micros = TIMEOUT_MILLISECONDS * 1000LL;
+transport *net;
+
+void clearSegments(){
+    total_segments = 0;
+    max_send_seq_num = 0;
+    successfully_sent = 0;
+}
+
+bool appendSegments(int file_id, const char *data, long long len){
+    int tag_size = file_id == NO_FILE_ID ? 0 : sizeof(manifest_tag);
+    int seg_data = MAX_SEG_SIZE - tag_size; // file bytes per segment
+    long long count = (len + seg_data - 1) / seg_data;
+    if (total_segments + count > MAX_SEGMENTS) return false;
+
+    //grow the transmit_queue
+    if (total_segments + count > queue_capacity){
+        queue_capacity = MAX(total_segments + (int)count, 2 * queue_capacity);
+        transmit_queue = (segment *) realloc(transmit_queue, sizeof(segment) * queue_capacity);
+    }
+    for (int i = 0; i < count; i++){
+        segment *sgmt = &transmit_queue[total_segments];
+        int curr_segment_size = seg_data;
+        // last segment and not aligned
+        if ((len % seg_data != 0) && (i == count - 1)){
+            curr_segment_size = len % seg_data;
+        }
+        memset(sgmt->data, 0, sizeof(char) * MAX_SEG_SIZE);
+        if (tag_size > 0){
+            manifest_tag tag = {MANIFEST_MAGIC, file_id, i * seg_data};
+            memcpy(sgmt->data, &tag, sizeof(tag));
+        }
+        memcpy(sgmt->data + tag_size, data + ((long long)i * seg_data), curr_segment_size);
+
+        sgmt->head.length = tag_size + curr_segment_size;
+        sgmt->head.seqNumber = total_segments + 1;
+        sgmt->head.ackNumber = 0;
+        sgmt->head.sackNumber = 0;
+        sgmt->head.fin = 0;
+        sgmt->head.syn = 0;
+        sgmt->head.ack = 0;
+        sgmt->head.checksum = crc32(0L, (const Bytef *)sgmt->data, MAX_SEG_SIZE);
+        retransmitted[total_segments] = false;
+        total_segments++;
+    }
+    return true;
+}
+
+void loadSegments(const char *data, int len){
+    clearSegments();
+    appendSegments(NO_FILE_ID, data, len);
+}
+
+void resetTimer(){
+    deadline = net->now() + timeout_micros;
+}
+
+long long remainingMicros(){
+    return MAX(0, deadline - net->now());
+}
+
+void transmitNew(int num){
+    if (num == 0) return;
+    // collected and sent together, so a transport with GSO needs one system call
+    segment *batch[SEND_BATCH];
+    int batch_count = 0;
+    int count = 0;
+    int k = base - 1;
+    while (k < total_segments){
+        k++;
+        // segments already acked, that means not in window
+        if (transmit_queue[k-1].head.ack == 1){
+            continue;
+        }
+
+        count++;
+        //send the last num number of segments in window
+        if (count > (int)cwnd - num){
+            batch[batch_count++] = &transmit_queue[k-1];
+            if (batch_count == SEND_BATCH){
+                net->sendBatch(batch, batch_count);
+                batch_count = 0;
+            }
+
+            if (k > max_send_seq_num){
+                LOG("send\tdata\t#%d,\twinSize = %d\n", k, (int)cwnd);
+                statInc(STAT_DATA_SENT);
+                send_time_us[k-1] = net->now();
+            }
+            else if (k <= max_send_seq_num){
+                LOG("resnd\tdata\t#%d,\twinSize = %d\n", k, (int)cwnd);
+                statInc(STAT_DATA_RESENT);
+                retransmitted[k-1] = true;
+            }
+            if (k > max_send_seq_num) max_send_seq_num = k;
+
+        }
+        if (count == (int)cwnd) break;
+    }
+    if (batch_count > 0) net->sendBatch(batch, batch_count);
+}
+
+void transmitMissing(){
+    segment *sgmt = &transmit_queue[base-1];
+    net->send(sgmt);
+    LOG("resnd\tdata\t#%d,\twinSize = %d\n", sgmt->head.seqNumber, (int)cwnd);
+    statInc(STAT_DATA_RESENT);
+    retransmitted[base-1] = true;
+}
+
+void setState(int curr_state){
+    state = curr_state;
+    statEnterPhase(curr_state, net->now());
+}
+
+bool isAtState(int curr_state){
+    if (state == curr_state) return true;
+    return false;
+}
+
+void markSACK(int seq_num){
+    // if first packet is corrupted, then seq_num is 0, so need to check border
+    if (seq_num >= 1 && seq_num <= total_segments){
+        if (transmit_queue[seq_num-1].head.ack == 0){
+            successfully_sent++;
+            statInc(STAT_GOODPUT_BYTES, transmit_queue[seq_num-1].head.length);
+            if (!retransmitted[seq_num-1]){
+                statRecord(STAT_HIST_RTT_US, net->now() - send_time_us[seq_num-1]);
+            }
+        }
+
+        transmit_queue[seq_num-1].head.ack = 1;
+    }
+}
+
+void updateBase(int ack_num){
+    // everything up to the cumulative ACK has arrived, even if the ACK that
+    // sack-ed one of them was lost (otherwise isAllAcked() never holds)
+    for (int k = base; k <= ack_num; k++) markSACK(k);
+    base = ack_num + 1;
+}
+
+void init(){
+    cwnd = 1, thresh = init_thresh, dup_ack = 0, base = 1;
+    transmitNew(1);
+    resetTimer();
+    setState(SLOWSTART);
+}
+
+void timeout(){
+    thresh = MAX(1, int(cwnd / 2));
+    cwnd = 1;
+    dup_ack = 0;
+    LOG("time\tout,\tthreshold = %d,\twinSize = %d\n", thresh, (int)cwnd);
+    statInc(STAT_TIMEOUT);
+    statRecord(STAT_HIST_CWND, (int)cwnd);
+    transmitMissing();
+    resetTimer();
+    setState(SLOWSTART);
+}
+
+void dupACK(segment *segment){
+    //dupACK: cumulative ACK < first segment in the transmit queue
+    dup_ack++;
+    statInc(STAT_DUP_ACK);
+    statRecord(STAT_HIST_CWND, (int)cwnd);
+    markSACK(segment->head.sackNumber);
+
+    //if all packets are in current window, then there are no more new packets to send
+    if (base + (int)cwnd - 1 >= total_segments) transmitNew(0);
+    //if packets is corrupted or dropped bcuz of out-of-buffer-range, then ack = sack, so don't need to send new packets
+    //ex: when first packets is corrupted, then ack = sack = 0, since no segments in window are removed
+    //and window also didn't increase, so transmit 0 new segments
+    else if (segment->head.ackNumber == segment->head.sackNumber) transmitNew(0);
+
+    else transmitNew(1);
+
+    if (dup_ack == 3){
+        statInc(STAT_FAST_RETRANSMIT);
+        transmitMissing();
+    }
+}
+
+void newACK(segment *segment){
+    //newACK: cumulative ACK >= first segment in the transmit queue
+    dup_ack = 0;
+    markSACK(segment->head.sackNumber);
+    updateBase(segment->head.ackNumber);
+    int increase;
+    double prev_cwnd = cwnd;
+    if (isAtState(SLOWSTART)){
+        increase = 1;
+        cwnd += 1;
+        if (cwnd >= thresh){
+            setState(CONGESTIONAVOID);
+        }
+    }
+    else if (isAtState(CONGESTIONAVOID)){
+        cwnd += (double)(1) / (int)(cwnd);
+        increase = (int)cwnd - (int)prev_cwnd;
+    }
+
+    statRecord(STAT_HIST_CWND, (int)cwnd);
+    //transmit new segments in window
+    transmitNew(1 + increase);
+    resetTimer();
+}
+
+void handleAck(segment *segment){
+    // transmit_queue[base-1] has seqNumber base
+    if (segment->head.ackNumber < base){
+        dupACK(segment);
+    }
+    else{
+        newACK(segment);
+    }
+}
+
+bool isAllAcked(){
+    return successfully_sent == total_segments;
+}
+
+bool run(){
+    init();
+    while (true){
+        //if all packets are successfully sent, break
+        if (isAllAcked()) break;
+
+        // handle timeout ASAP
+        long long remaining_time = remainingMicros();
+        if (remaining_time == 0){
+            timeout();
+            continue;
+        }
+
+        segment recv_segment;
+        if (!net->recv(&recv_segment, remaining_time)){
+            timeout();
+            continue;
+        }
+        // There is incoming data from receiver
+        LOG("recv\tack\t#%d,\tsack\t#%d\n", recv_segment.head.ackNumber, recv_segment.head.sackNumber);
+        statInc(STAT_ACK_RECV);
+        handleAck(&recv_segment);
+    }
+
+    segment fin_segment;
+    memset(&fin_segment, 0, sizeof(fin_segment));
+    fin_segment.head.fin = 1;
+    fin_segment.head.seqNumber = total_segments + 1;
+    net->send(&fin_segment);
+    LOG("send\tfin\n");
+
+    // keep receiving until it is finack
+    while (true){
+        segment finack_segment;
+        if (!net->recv(&finack_segment, -1)) return false;
+        if (finack_segment.head.fin == 1 && finack_segment.head.ack == 1){
+            LOG("recv\tfinack\n");
+            return true;
+        }
+    }
+}
+
+} // namespace sender_fsm
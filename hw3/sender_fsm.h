@@ -0,0 +1,76 @@
+/*
+    Sender state machine (see fsm.py), independent of sockets and timers.
+    Segments go out through `net` and the retransmission timer is a deadline
+    on net->now(), so the same code runs over UDP, in the simulator and in
+    benchmarks that feed ACKs to handleAck() directly.
+*/
+
+#ifndef SENDER_FSM_HEADER
+#define SENDER_FSM_HEADER
+
+#include "def.h"
+#include "transport.h"
+
+#define MAX_SEGMENTS 1000000
+#define SLOWSTART 0
+#define CONGESTIONAVOID 1
+#define INIT_THRESH 16
+#define NO_FILE_ID -1   // appendSegments() of a plain, untagged transfer
+
+namespace sender_fsm {
+
+extern segment *transmit_queue;   // transmit_queue[i] has seqNumber i+1
+extern int total_segments;
+extern int max_send_seq_num;
+extern int successfully_sent;
+
+extern double cwnd;
+extern int thresh, dup_ack;
+extern int init_thresh;
+extern int state;
+extern int base;
+
+extern long long timeout_micros;  // TIMEOUT_MILLISECONDS unless overridden
+
+// where segments go out and the clock of the timer, must be set before init()
+extern transport *net;
+
+// Empty the transmit queue
+void clearSegments();
+// Split one file into segments (with checksum) at the end of the transmit
+// queue. Unless file_id is NO_FILE_ID, each segment starts with the
+// manifest_tag of file_id and its offset (see manifest.h). Returns false if
+// that would exceed MAX_SEGMENTS.
+bool appendSegments(int file_id, const char *data, long long len);
+// clearSegments() + appendSegments() of a single file
+void loadSegments(const char *data, int len);
+
+void resetTimer();
+// Microseconds until the retransmission timer expires, 0 if it already has
+long long remainingMicros();
+
+void transmitNew(int num);
+void transmitMissing();
+void setState(int curr_state);
+bool isAtState(int curr_state);
+void markSACK(int seq_num);
+void updateBase(int ack_num);
+
+void init();
+void timeout();
+void dupACK(segment *segment);
+void newACK(segment *segment);
+
+// Dispatch an ACK segment to dupACK / newACK
+void handleAck(segment *segment);
+
+// True if every segment has been sack-ed
+bool isAllAcked();
+
+// Send everything loaded, then FIN, until FINACK. Returns false if the
+// transport gave up (only possible in the simulator).
+bool run();
+
+} // namespace sender_fsm
+
+#endif // SENDER_FSM_HEADER
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <random>
+
+#include "sim.h"
+#include "agent_core.h"
+
+using namespace std;
+
+static mt19937 sim_rng;
+
+static int simRand(){
+    return sim_rng() & 0x7fffffff;
+}
+
+sim_link::sim_link(const sim_config &config) : config(config) {
+    sender.link = this;
+    receiver.link = this;
+    sim_rng.seed(config.seed);
+}
+
+void sim_link::transmit(sim_endpoint *src, segment *sgmt){
+    sim_endpoint *dst = src == &sender ? &receiver : &sender;
+    sim_event ev;
+    ev.sgmt = *sgmt;
+
+    // same rules as agent.cpp: only data segments from the sender get lost
+    if (src == &sender && ev.sgmt.head.fin == 0){
+        data_total++;
+        int decision = agentDecide(config.error_rate, simRand);
+        if (decision == AGENT_DROP){
+            data_dropped++;
+            return;
+        }
+        if (decision == AGENT_CORRUPT){
+            data_corrupted++;
+            corruptData(ev.sgmt.data, MAX_SEG_SIZE);
+        }
+    }
+
+    double depart = clock;
+    if (config.bandwidth_mbps > 0){
+        // Mbps == bits per microsecond
+        src->free_at = max(src->free_at, (double)clock) + sizeof(segment) * 8 / config.bandwidth_mbps;
+        depart = src->free_at;
+    }
+    ev.time = (long long)depart + config.delay_us;
+    ev.order = order++;
+    ev.dst = dst;
+    events.push(ev);
+}
+
+bool sim_link::next(sim_endpoint *dst, segment *sgmt, long long deadline){
+    while (!events.empty()){
+        if (deadline >= 0 && events.top().time > deadline) break;
+        sim_event ev = events.top();
+        events.pop();
+        clock = max(clock, ev.time);
+        if (ev.dst == dst && dst->handler == NULL){
+            *sgmt = ev.sgmt;
+            return true;
+        }
+        ev.dst->handler(&ev.sgmt);
+    }
+    // with no deadline and nothing in flight we would wait forever
+    if (deadline < 0) return false;
+    clock = max(clock, deadline);
+    return false;
+}
+
+void sim_endpoint::send(segment *sgmt){
+    link->transmit(this, sgmt);
+}
+
+bool sim_endpoint::recv(segment *sgmt, long long timeout_us){
+    return link->next(this, sgmt, timeout_us < 0 ? -1 : link->clock + timeout_us);
+}
+
+long long sim_endpoint::now(){
+    return link->clock;
+}
@@ -0,0 +1,81 @@
+/*
+    In-memory network for simulate.cpp: one link between a sender endpoint
+    and a receiver endpoint, through the agent's drop / corrupt model
+    (agent_core.h), with a virtual clock. Nothing ever sleeps: waiting for a
+    segment just advances the clock to the next event, so a run with 1 s
+    timeouts takes as long as the state machines need to compute it.
+
+    The sender side is "blocking" (sender_fsm::run() calls recv), the
+    receiver side is event driven: segments for it are handed to `handler`
+    while the sender waits.
+*/
+
+#ifndef SIM_HEADER
+#define SIM_HEADER
+
+#include <queue>
+#include <vector>
+
+#include "def.h"
+#include "transport.h"
+
+struct sim_config {
+    float error_rate;       // as the agent's <error_rate>
+    long long delay_us;     // one-way propagation delay
+    double bandwidth_mbps;  // serialization rate per direction, 0 for infinite
+    unsigned int seed;      // for the agent's drop / corrupt decisions
+};
+
+class sim_link;
+
+class sim_endpoint : public transport {
+public:
+    void send(segment *sgmt) override;
+    bool recv(segment *sgmt, long long timeout_us) override;
+    long long now() override;
+
+    // if set, segments for this endpoint are delivered here instead of recv()
+    void (*handler)(segment *sgmt) = NULL;
+
+private:
+    friend class sim_link;
+    sim_link *link;
+    double free_at = 0; // when the outgoing direction finishes serializing
+};
+
+struct sim_event {
+    long long time;
+    long long order;        // FIFO among events at the same time
+    sim_endpoint *dst;
+    segment sgmt;
+};
+
+struct sim_event_later {
+    bool operator()(const sim_event &a, const sim_event &b) const {
+        if (a.time != b.time) return a.time > b.time;
+        return a.order > b.order;
+    }
+};
+
+class sim_link {
+public:
+    sim_link(const sim_config &config);
+
+    sim_endpoint sender, receiver;
+    long long clock = 0;    // virtual microseconds
+
+    // what the agent did to data segments
+    long long data_total = 0, data_dropped = 0, data_corrupted = 0;
+
+private:
+    friend class sim_endpoint;
+    void transmit(sim_endpoint *src, segment *sgmt);
+    // Next segment for dst arriving no later than deadline (-1: no limit)
+    bool next(sim_endpoint *dst, segment *sgmt, long long deadline);
+
+    sim_config config;
+    long long order = 0;
+    std::priority_queue<sim_event, std::vector<sim_event>, sim_event_later> events;
+};
+
+#endif // SIM_HEADER
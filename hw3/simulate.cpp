@@ -0,0 +1,192 @@
+/*
+    Run sender and receiver in one process over the simulated link (sim.h),
+    for fast parameter sweeps. Every comma separated list is swept, one CSV
+    line per run (virtual time, goodput, retransmissions, timeouts, ...).
+
+    E.g. 100 MB at 20% loss, three thresholds and two timeouts:
+        $ ./simulate --size 100M --error-rate 0.2 --thresh 8,16,64 --timeout-ms 200,1000
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <random>
+#include <string>
+#include <vector>
+#include <openssl/evp.h>
+
+#include "def.h"
+#include "sender_fsm.h"
+#include "receiver_fsm.h"
+#include "sim.h"
+#include "stats.h"
+
+using namespace std;
+
+static vector<double> parseList(const char *s){
+    vector<double> values;
+    char *end;
+    while (*s){
+        values.push_back(strtod(s, &end));
+        if (*end == 'K' || *end == 'k') values.back() *= 1000, end++;
+        else if (*end == 'M' || *end == 'm') values.back() *= 1000 * 1000, end++;
+        if (*end == ',') end++;
+        else if (*end != '\0'){
+            fprintf(stderr, "Cannot parse list \"%s\"\n", s);
+            exit(1);
+        }
+        s = end;
+    }
+    return values;
+}
+
+static void sha256Hex(const char *data, size_t len, char *out){
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int hash_len;
+    EVP_Digest(data, len, hash, &hash_len, EVP_sha256(), NULL);
+    for (unsigned int i = 0; i < hash_len; ++i)
+        sprintf(out + i * 2, "%02x", hash[i]);
+}
+
+static void usage(const char *prog){
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --size <bytes>          generated file size, K / M suffix allowed (default 10M)\n"
+        "  --file <path>           send this file instead of generated data\n"
+        "  --error-rate <list>     agent error rate (default 0.1)\n"
+        "  --thresh <list>         sender's initial threshold (default %d)\n"
+        "  --buf-size <list>       receiver buffer in segments (default %d)\n"
+        "  --timeout-ms <list>     retransmission timeout (default %d)\n"
+        "  --delay-us <n>          one-way delay (default 50)\n"
+        "  --bandwidth-mbps <n>    link rate, 0 for infinite (default 0)\n"
+        "  --seed <n>              first seed for the agent's decisions (default 1)\n"
+        "  --runs <n>              runs per configuration, seed, seed+1, ... (default 1)\n"
+        "  --csv <path>            write results there instead of stdout\n",
+        prog, INIT_THRESH, MAX_SEG_BUF_SIZE, TIMEOUT_MILLISECONDS);
+    exit(1);
+}
+
+int main(int argc, char *argv[]){
+    double size = 10 * 1000 * 1000;
+    const char *file = NULL, *csv = NULL;
+    vector<double> error_rates = {0.1}, threshes = {INIT_THRESH}, buf_sizes = {MAX_SEG_BUF_SIZE};
+    vector<double> timeouts = {TIMEOUT_MILLISECONDS};
+    sim_config config = {0, 50, 0, 1};
+    int runs = 1;
+
+    static struct option long_options[] = {
+        {"size", required_argument, 0, 's'},
+        {"file", required_argument, 0, 'f'},
+        {"error-rate", required_argument, 0, 'e'},
+        {"thresh", required_argument, 0, 't'},
+        {"buf-size", required_argument, 0, 'b'},
+        {"timeout-ms", required_argument, 0, 'o'},
+        {"delay-us", required_argument, 0, 'd'},
+        {"bandwidth-mbps", required_argument, 0, 'w'},
+        {"seed", required_argument, 0, 'r'},
+        {"runs", required_argument, 0, 'n'},
+        {"csv", required_argument, 0, 'c'},
+        {0, 0, 0, 0}
+    };
+    int c;
+    while ((c = getopt_long(argc, argv, "", long_options, NULL)) != -1){
+        switch (c){
+            case 's': size = parseList(optarg).at(0); break;
+            case 'f': file = optarg; break;
+            case 'e': error_rates = parseList(optarg); break;
+            case 't': threshes = parseList(optarg); break;
+            case 'b': buf_sizes = parseList(optarg); break;
+            case 'o': timeouts = parseList(optarg); break;
+            case 'd': config.delay_us = atoll(optarg); break;
+            case 'w': config.bandwidth_mbps = atof(optarg); break;
+            case 'r': config.seed = atoi(optarg); break;
+            case 'n': runs = atoi(optarg); break;
+            case 'c': csv = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc) usage(argv[0]);
+
+    // the data to send
+    vector<char> data;
+    if (file != NULL){
+        FILE *fp = fopen(file, "rb");
+        if (fp == NULL){
+            perror("Error opening file");
+            exit(1);
+        }
+        fseek(fp, 0, SEEK_END);
+        data.resize(ftell(fp));
+        fseek(fp, 0, SEEK_SET);
+        if (fread(data.data(), 1, data.size(), fp) != data.size()){
+            perror("Error reading file");
+            exit(1);
+        }
+        fclose(fp);
+    }
+    else{
+        data.resize((size_t)size);
+        mt19937 gen(318);
+        for (size_t i = 0; i < data.size(); i++) data[i] = (char)gen();
+    }
+    if (data.size() > (size_t)MAX_SEGMENTS * MAX_SEG_SIZE){
+        fprintf(stderr, "At most %d segments can be sent\n", MAX_SEGMENTS);
+        exit(1);
+    }
+    char src_sha[EVP_MAX_MD_SIZE * 2 + 1];
+    sha256Hex(data.data(), data.size(), src_sha);
+
+    FILE *out = csv ? fopen(csv, "w") : stdout;
+    if (out == NULL){
+        perror("Error opening csv");
+        exit(1);
+    }
+    fprintf(out, "size,error_rate,thresh,buf_size,timeout_ms,seed,ok,sim_s,goodput_mbps,"
+                 "data_sent,data_resent,retrans_ratio,timeouts,fast_retransmits,dropped,corrupted,"
+                 "buffer_overflow,flushes,slow_start_s,congestion_avoid_s,wall_ms\n");
+
+    for (double error_rate : error_rates)
+    for (double thresh : threshes)
+    for (double buf_size : buf_sizes)
+    for (double timeout_ms : timeouts)
+    for (int run = 0; run < runs; run++){
+        auto wall_start = chrono::steady_clock::now();
+        statReset();
+
+        sim_config run_config = config;
+        run_config.error_rate = error_rate;
+        run_config.seed = config.seed + run;
+        sim_link link(run_config);
+
+        sender_fsm::net = &link.sender;
+        sender_fsm::init_thresh = (int)thresh;
+        sender_fsm::timeout_micros = (long long)(timeout_ms * 1000);
+        sender_fsm::loadSegments(data.data(), data.size());
+
+        receiver_fsm::net = &link.receiver;
+        receiver_fsm::deliver = NULL;   // the running sha256 is enough to check the result
+        receiver_fsm::init((int)buf_size);
+        link.receiver.handler = receiver_fsm::receiveDataPacket;
+
+        bool finished = sender_fsm::run();
+        char dst_sha[EVP_MAX_MD_SIZE * 2 + 1];
+        receiver_fsm::sha256Hex(dst_sha);
+        bool ok = finished && receiver_fsm::endflag && strcmp(src_sha, dst_sha) == 0;
+
+        double wall_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - wall_start).count();
+        double sim_s = link.clock / 1e6;
+        unsigned long sent = stat_counters[STAT_DATA_SENT], resent = stat_counters[STAT_DATA_RESENT];
+        fprintf(out, "%zu,%g,%d,%d,%g,%u,%d,%.6f,%.3f,%lu,%lu,%.4f,%lu,%lu,%lld,%lld,%lu,%lu,%.6f,%.6f,%.1f\n",
+            data.size(), error_rate, (int)thresh, (int)buf_size, timeout_ms, run_config.seed, ok,
+            sim_s, sim_s > 0 ? receiver_fsm::delivered_bytes * 8 / sim_s / 1e6 : 0,
+            sent, resent, sent ? (double)resent / sent : 0,
+            (unsigned long)stat_counters[STAT_TIMEOUT], (unsigned long)stat_counters[STAT_FAST_RETRANSMIT],
+            link.data_dropped, link.data_corrupted,
+            (unsigned long)stat_counters[STAT_DATA_DROPPED], (unsigned long)stat_counters[STAT_FLUSH],
+            statPhaseMicros(SLOWSTART, link.clock) / 1e6, statPhaseMicros(CONGESTIONAVOID, link.clock) / 1e6, wall_ms);
+        fflush(out);
+    }
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <time.h>
+
+#include "stats.h"
+
+using namespace std;
+
+struct histogram {
+    atomic<unsigned long> bucket[STAT_HIST_BUCKETS]; // bucket i holds values in [2^(i-1), 2^i)
+    atomic<unsigned long> count, sum, max;
+    atomic<unsigned long> min;
+};
+
+atomic<unsigned long> stat_counters[STAT_COUNTER_MAX];
+
+static histogram hists[STAT_HIST_MAX];
+static atomic<long long> phase_micros[STAT_PHASE_MAX];
+static atomic<int> curr_phase(-1);
+static atomic<long long> phase_start;
+static long long start_micros;
+static const char *stat_role;
+static FILE *stat_fp;
+static mutex dump_mutex; // periodic and exit reports must not interleave
+
+static const char *counter_names[STAT_COUNTER_MAX] = {
+    "data_sent", "data_resent", "data_recv", "data_dropped", "data_corrupted",
+    "ack_sent", "ack_recv", "dup_ack", "timeout", "fast_retransmit", "flush",
+    "goodput_bytes",
+    "sys_sendto", "send_failed", "sys_recvfrom", "sys_select", "sys_read", "sys_write",
+    "sys_log_write", "sys_io_uring_enter",
+};
+static const char *hist_names[STAT_HIST_MAX] = {"cwnd", "rtt_us"};
+static const char *phase_names[STAT_PHASE_MAX] = {"slow_start", "congestion_avoid"};
+
+long long statNowMicros(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+void statRecord(int hist, unsigned long value){
+    histogram *h = &hists[hist];
+    int b = value == 0 ? 0 : 64 - __builtin_clzl(value);
+    if (b >= STAT_HIST_BUCKETS) b = STAT_HIST_BUCKETS - 1;
+    h->bucket[b].fetch_add(1, memory_order_relaxed);
+    h->sum.fetch_add(value, memory_order_relaxed);
+
+    // only the owning thread records, so load + store is enough for min / max
+    if (h->count.fetch_add(1, memory_order_relaxed) == 0 || value < h->min.load(memory_order_relaxed)){
+        h->min.store(value, memory_order_relaxed);
+    }
+    if (value > h->max.load(memory_order_relaxed)){
+        h->max.store(value, memory_order_relaxed);
+    }
+}
+
+void statEnterPhase(int phase, long long now_us){
+    long long now = now_us;
+    int prev = curr_phase.load(memory_order_relaxed);
+    if (prev == phase) return;
+    if (prev >= 0){
+        phase_micros[prev].fetch_add(now - phase_start.load(memory_order_relaxed), memory_order_relaxed);
+    }
+    phase_start.store(now, memory_order_relaxed);
+    curr_phase.store(phase, memory_order_relaxed);
+}
+
+long long statPhaseMicros(int phase, long long now_us){
+    long long t = phase_micros[phase].load(memory_order_relaxed);
+    if (phase == curr_phase.load(memory_order_relaxed)) t += now_us - phase_start.load(memory_order_relaxed);
+    return t;
+}
+
+void statReset(){
+    for (int i = 0; i < STAT_COUNTER_MAX; i++) stat_counters[i].store(0, memory_order_relaxed);
+    for (int i = 0; i < STAT_HIST_MAX; i++){
+        histogram *h = &hists[i];
+        for (int b = 0; b < STAT_HIST_BUCKETS; b++) h->bucket[b].store(0, memory_order_relaxed);
+        h->count.store(0, memory_order_relaxed);
+        h->sum.store(0, memory_order_relaxed);
+        h->max.store(0, memory_order_relaxed);
+        h->min.store(0, memory_order_relaxed);
+    }
+    for (int i = 0; i < STAT_PHASE_MAX; i++) phase_micros[i].store(0, memory_order_relaxed);
+    curr_phase.store(-1, memory_order_relaxed);
+    start_micros = statNowMicros();
+}
+
+void statDump(FILE *fp){
+    lock_guard<mutex> lock(dump_mutex);
+    long long now = statNowMicros();
+    long long elapsed = now - start_micros;
+    fprintf(fp, "{\"role\":\"%s\",\"elapsed_ms\":%.3f", stat_role, elapsed / 1000.0);
+
+    fprintf(fp, ",\"counters\":{");
+    for (int i = 0; i < STAT_COUNTER_MAX; i++){
+        fprintf(fp, "%s\"%s\":%lu", i ? "," : "", counter_names[i], stat_counters[i].load(memory_order_relaxed));
+    }
+    fprintf(fp, "}");
+
+    unsigned long goodput = stat_counters[STAT_GOODPUT_BYTES].load(memory_order_relaxed);
+    double goodput_mbps = elapsed > 0 ? goodput * 8.0 / elapsed : 0;
+    fprintf(fp, ",\"goodput_mbps\":%.3f", goodput_mbps);
+
+    fprintf(fp, ",\"phases_ms\":{");
+    // the report is only written by the real binaries, whose clock is this one
+    for (int i = 0; i < STAT_PHASE_MAX; i++){
+        long long t = statPhaseMicros(i, now);
+        fprintf(fp, "%s\"%s\":%.3f", i ? "," : "", phase_names[i], t / 1000.0);
+    }
+    fprintf(fp, "}");
+
+    fprintf(fp, ",\"histograms\":{");
+    for (int i = 0; i < STAT_HIST_MAX; i++){
+        histogram *h = &hists[i];
+        unsigned long count = h->count.load(memory_order_relaxed);
+        fprintf(fp, "%s\"%s\":{\"count\":%lu,\"sum\":%lu,\"min\":%lu,\"max\":%lu,\"buckets\":[",
+            i ? "," : "", hist_names[i], count, h->sum.load(memory_order_relaxed),
+            count ? h->min.load(memory_order_relaxed) : 0, h->max.load(memory_order_relaxed));
+        bool first = true;
+        for (int b = 0; b < STAT_HIST_BUCKETS; b++){
+            unsigned long n = h->bucket[b].load(memory_order_relaxed);
+            if (n == 0) continue;
+            // "lt": exclusive upper bound of the bucket
+            fprintf(fp, "%s{\"lt\":%lu,\"count\":%lu}", first ? "" : ",", b == 0 ? 1UL : 1UL << b, n);
+            first = false;
+        }
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "}}\n");
+    fflush(fp);
+}
+
+static void dumpAtExit(){
+    statDump(stat_fp);
+}
+
+static void dumpPeriodically(int interval_ms){
+    while (true){
+        this_thread::sleep_for(chrono::milliseconds(interval_ms));
+        statDump(stat_fp);
+    }
+}
+
+void statInit(const char *role, const char *path, int interval_ms){
+    stat_role = role;
+    start_micros = statNowMicros();
+    if (path == NULL) return;
+
+    if (strcmp(path, "-") == 0) stat_fp = stderr;
+    else stat_fp = fopen(path, "w");
+    if (stat_fp == NULL){
+        perror("Error opening stats file");
+        exit(EXIT_FAILURE);
+    }
+    atexit(dumpAtExit);
+    if (interval_ms > 0){
+        thread(dumpPeriodically, interval_ms).detach();
+    }
+}
@@ -0,0 +1,83 @@
+/*
+    Lightweight transfer statistics shared by sender, receiver and agent.
+    Counters and histograms are lock-free (relaxed atomics), so they are
+    cheap enough to bump on the per-packet path. Nothing is written to
+    stdout: the JSON report goes to stderr or to the file given by --stats.
+*/
+
+#ifndef STATS_HEADER
+#define STATS_HEADER
+
+#include <atomic>
+#include <cstdio>
+
+// packet / event counters
+enum stat_counter {
+    STAT_DATA_SENT,         // first transmission of a data segment
+    STAT_DATA_RESENT,       // retransmission of a data segment
+    STAT_DATA_RECV,         // data segment accepted (in order or sack-ed)
+    STAT_DATA_DROPPED,      // data segment dropped (loss or buffer overflow)
+    STAT_DATA_CORRUPTED,    // data segment corrupted / failed checksum
+    STAT_ACK_SENT,
+    STAT_ACK_RECV,
+    STAT_DUP_ACK,
+    STAT_TIMEOUT,
+    STAT_FAST_RETRANSMIT,
+    STAT_FLUSH,
+    STAT_GOODPUT_BYTES,     // unique payload bytes acked / delivered / forwarded
+    STAT_SYS_SENDTO,
+    STAT_SEND_FAILED,       // segments the kernel refused to send (lost)
+    STAT_SYS_RECVFROM,
+    STAT_SYS_SELECT,
+    STAT_SYS_READ,
+    STAT_SYS_WRITE,         // file writes (receiver)
+    STAT_SYS_LOG_WRITE,     // log flushes to stdout
+    STAT_SYS_IO_URING_ENTER,
+    STAT_COUNTER_MAX
+};
+
+// log2-bucketed histograms
+enum stat_hist {
+    STAT_HIST_CWND,
+    STAT_HIST_RTT_US,
+    STAT_HIST_MAX
+};
+
+// sender congestion control phases, same values as SLOWSTART / CONGESTIONAVOID
+#define STAT_PHASE_MAX 2
+
+#define STAT_HIST_BUCKETS 64
+
+extern std::atomic<unsigned long> stat_counters[STAT_COUNTER_MAX];
+
+// Start the clock for `role` and arrange for a JSON report to be written at
+// exit to `path` ("-" is stderr). If interval_ms > 0, a report line is also
+// appended every interval_ms. A NULL path only counts, never reports.
+void statInit(const char *role, const char *path, int interval_ms);
+
+static inline void statInc(int counter, unsigned long n = 1){
+    stat_counters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+// Add a sample to histogram `hist`
+void statRecord(int hist, unsigned long value);
+
+// Account the time spent in the previous phase and switch to `phase`. now_us
+// is the caller's clock (net->now()): statNowMicros() for a real transfer,
+// the virtual clock in the simulator.
+void statEnterPhase(int phase, long long now_us);
+
+// Time spent in `phase` so far, the current phase counted up to now_us
+// (same clock as statEnterPhase())
+long long statPhaseMicros(int phase, long long now_us);
+
+// Zero every counter, histogram and phase time (e.g. between simulated runs)
+void statReset();
+
+// Monotonic clock in microseconds
+long long statNowMicros();
+
+// Write one JSON object (single line) describing the current statistics
+void statDump(FILE *fp);
+
+#endif // STATS_HEADER
@@ -0,0 +1,146 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/udp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+
+#include "transport.h"
+#include "stats.h"
+
+// One datagram, failures counted (and the first one reported)
+static void udpSend(int sock_fd, const struct sockaddr_in *addr, segment *sgmt){
+    static bool reported = false;
+    int result = sendto(sock_fd, sgmt, sizeof(*sgmt), 0, (const struct sockaddr *)addr, sizeof(*addr));
+    statInc(STAT_SYS_SENDTO);
+    if (result < 0){
+        statInc(STAT_SEND_FAILED);
+        if (!reported) fprintf(stderr, "Error in sendto: %s (further failures only counted)\n", strerror(errno));
+        reported = true;
+    }
+}
+
+void udpSendSegments(int sock_fd, const struct sockaddr_in *addr, segment **sgmts, int n, bool *gso){
+    static segment batch[GSO_MAX_SEGMENTS];
+    int sent = 0;
+    while (*gso && n - sent > 1){
+        int count = n - sent < GSO_MAX_SEGMENTS ? n - sent : GSO_MAX_SEGMENTS;
+        for (int i = 0; i < count; i++) memcpy(&batch[i], sgmts[sent + i], sizeof(segment));
+
+        struct iovec iov = {batch, count * sizeof(segment)};
+        char control[CMSG_SPACE(sizeof(uint16_t))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = (void *)addr;
+        msg.msg_namelen = sizeof(*addr);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        *(uint16_t *)CMSG_DATA(cmsg) = sizeof(segment);
+
+        int result = sendmsg(sock_fd, &msg, 0);
+        statInc(STAT_SYS_SENDTO);
+        if (result < 0){
+            if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP || errno == EMSGSIZE){
+                // no GSO here (old kernel, no checksum offload on the device, MTU, ...)
+                fprintf(stderr, "UDP GSO unavailable (%s), sending one datagram per segment\n", strerror(errno));
+                *gso = false;
+            }
+            // otherwise (ENOBUFS, EAGAIN, ...) only this batch goes without GSO
+            for (int i = 0; i < count; i++) udpSend(sock_fd, addr, sgmts[sent + i]);
+        }
+        sent += count;
+    }
+    for (; sent < n; sent++) udpSend(sock_fd, addr, sgmts[sent]);
+}
+
+udp_reader::udp_reader(int sock_fd, bool gro) : sock_fd(sock_fd), gro(gro){
+    int on = 1;
+    if (gro && setsockopt(sock_fd, SOL_UDP, UDP_GRO, &on, sizeof(on)) != 0){
+        fprintf(stderr, "UDP GRO unavailable (%s), receiving one datagram per segment\n", strerror(errno));
+        this->gro = false;
+    }
+}
+
+int udp_reader::next(segment *sgmt, struct sockaddr_in *from){
+    socklen_t from_size = sizeof(*from);
+    if (!gro){
+        int result = recvfrom(sock_fd, sgmt, sizeof(*sgmt), 0, (struct sockaddr *)from, from ? &from_size : NULL);
+        statInc(STAT_SYS_RECVFROM);
+        return result;
+    }
+
+    if (!pending()){
+        struct iovec iov = {buf, sizeof(buf)};
+        char control[CMSG_SPACE(sizeof(int))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &buf_from;
+        msg.msg_namelen = sizeof(buf_from);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        int result = recvmsg(sock_fd, &msg, 0);
+        statInc(STAT_SYS_RECVFROM);
+        if (result <= 0) return result;
+
+        // without the cmsg it is a plain datagram
+        length = result, offset = 0, seg_size = result;
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO){
+                seg_size = *(int *)CMSG_DATA(cmsg);
+            }
+        }
+    }
+
+    int size = length - offset < seg_size ? length - offset : seg_size;
+    memcpy(sgmt, buf + offset, size < (int)sizeof(*sgmt) ? size : sizeof(*sgmt));
+    offset += size;
+    if (from) *from = buf_from;
+    return size;
+}
+
+udp_transport::udp_transport(int sock_fd, struct sockaddr_in peer_addr, bool offload)
+    : sock_fd(sock_fd), peer_addr(peer_addr), gso(offload), reader(sock_fd, offload) {}
+
+void udp_transport::send(segment *sgmt){
+    udpSend(sock_fd, &peer_addr, sgmt);
+}
+
+void udp_transport::sendBatch(segment **sgmts, int n){
+    udpSendSegments(sock_fd, &peer_addr, sgmts, n, &gso);
+}
+
+bool udp_transport::recv(segment *sgmt, long long timeout_us){
+    if (timeout_us >= 0 && !reader.pending()){
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sock_fd, &read_fds);
+        struct timeval select_timeout;
+        select_timeout.tv_sec = timeout_us / 1000000;
+        select_timeout.tv_usec = timeout_us % 1000000;
+
+        int select_result = select(sock_fd + 1, &read_fds, NULL, NULL, &select_timeout);
+        statInc(STAT_SYS_SELECT);
+        if (select_result == -1){
+            perror("Error in select");
+            exit(EXIT_FAILURE);
+        }
+        if (select_result == 0) return false;
+    }
+    // the peer is always the agent, no need to look at the source address
+    reader.next(sgmt, NULL);
+    return true;
+}
+
+long long udp_transport::now(){
+    return statNowMicros();
+}
@@ -0,0 +1,83 @@
+/*
+    How the state machines talk to the network. The real binaries use a UDP
+    socket (udp_transport); simulate.cpp uses an in-memory link with a
+    virtual clock (sim.h), so the same sender / receiver code runs in both.
+*/
+
+#ifndef TRANSPORT_HEADER
+#define TRANSPORT_HEADER
+
+#include <netinet/in.h>
+
+#include "def.h"
+
+// Segments per UDP_SEGMENT (GSO) send: the kernel allows 64, and the whole
+// super-datagram has to fit in one 64 KB UDP datagram
+#define GSO_MAX_SEGMENTS (64 < 65507 / (int)sizeof(segment) ? 64 : 65507 / (int)sizeof(segment))
+
+class transport {
+public:
+    virtual ~transport() {}
+    // Send one segment to the peer (always through the agent)
+    virtual void send(segment *sgmt) = 0;
+    // Send n segments in this order, as few system calls as the transport can
+    virtual void sendBatch(segment **sgmts, int n) {
+        for (int i = 0; i < n; i++) send(sgmts[i]);
+    }
+    // Wait at most timeout_us (forever if negative) for the next segment.
+    // Returns true if one was stored in sgmt, false on timeout.
+    virtual bool recv(segment *sgmt, long long timeout_us) = 0;
+    // Microseconds on this transport's clock
+    virtual long long now() = 0;
+};
+
+// Send n segments to addr. With *gso set they go out as UDP_SEGMENT
+// super-datagrams of up to GSO_MAX_SEGMENTS segments, which the kernel
+// splits into one datagram per segment (in the NIC, or not at all if the
+// peer socket has UDP_GRO). If the kernel does not support it, *gso is
+// cleared and the segments are sent one sendto() each, as without it. A
+// super-datagram that fails otherwise (ENOBUFS, EAGAIN, ...) is retried one
+// segment at a time. Segments that still fail are counted in
+// STAT_SEND_FAILED (the first failure is also noted on stderr); they are
+// lost like a dropped datagram and retransmitted by the protocol.
+void udpSendSegments(int sock_fd, const struct sockaddr_in *addr, segment **sgmts, int n, bool *gso);
+
+// Receiving side of a UDP socket. With UDP_GRO the kernel may hand several
+// segments from the same peer to one recvmsg(); they are split here and
+// returned one at a time.
+class udp_reader {
+public:
+    // gro: try to enable UDP_GRO on the socket (silently off if unsupported)
+    udp_reader(int sock_fd, bool gro);
+    // Next segment (blocks if none is left from the last system call).
+    // Returns its size, or what recvfrom / recvmsg returned if <= 0.
+    // from may be NULL.
+    int next(segment *sgmt, struct sockaddr_in *from);
+    // True if next() can return without a system call
+    bool pending() { return offset < length; }
+
+private:
+    int sock_fd;
+    bool gro;
+    char buf[65536];
+    int length = 0, offset = 0, seg_size = 0;
+    struct sockaddr_in buf_from;
+};
+
+class udp_transport : public transport {
+public:
+    // offload: send with UDP GSO and receive with UDP GRO where the kernel supports it
+    udp_transport(int sock_fd, struct sockaddr_in peer_addr, bool offload = false);
+    void send(segment *sgmt) override;
+    void sendBatch(segment **sgmts, int n) override;
+    bool recv(segment *sgmt, long long timeout_us) override;
+    long long now() override;
+
+private:
+    int sock_fd;
+    struct sockaddr_in peer_addr;
+    bool gso;
+    udp_reader reader;
+};
+
+#endif // TRANSPORT_HEADER
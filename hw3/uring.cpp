@@ -0,0 +1,322 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "uring.h"
+#include "stats.h"
+
+#define BUF_GROUP 0
+
+// user_data of a request: what it is, and which slot / buffer it uses
+#define KIND_RECV 1
+#define KIND_SEND 2
+#define KIND_WRITE 3
+#define USER_DATA(kind, index) ((__u64)(kind) | ((__u64)(index) << 8))
+
+uring_transport::uring_transport(int sock_fd, struct sockaddr_in peer_addr)
+    : sock_fd(sock_fd), peer_addr(peer_addr) {
+    memset(send_slots, 0, sizeof(send_slots));
+    memset(write_slots, 0, sizeof(write_slots));
+}
+
+uring_transport::~uring_transport(){
+    if (ring_fd >= 0) close(ring_fd);
+    if (sqes != NULL) munmap(sqes, sq_entries * sizeof(struct io_uring_sqe));
+    if (cq_ptr != NULL && cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+    if (sq_ptr != NULL) munmap(sq_ptr, sq_size);
+    if (buf_ring != NULL) munmap(buf_ring, URING_RECV_BUFS * sizeof(struct io_uring_buf));
+    free(recv_bufs);
+}
+
+bool uring_transport::init(){
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring_fd < 0) return false;
+    sq_entries = params.sq_entries;
+
+    // map the submission / completion rings (one mapping on kernels with SINGLE_MMAP)
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP){
+        if (cq_size > sq_size) sq_size = cq_size;
+        cq_size = sq_size;
+    }
+    sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED){
+        sq_ptr = NULL;
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) cq_ptr = sq_ptr;
+    else{
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED){
+            cq_ptr = NULL;
+            return false;
+        }
+    }
+    void *sqes_ptr = mmap(NULL, sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED) return false;
+    sqes = (struct io_uring_sqe *)sqes_ptr;
+
+    sq_head = (unsigned *)((char *)sq_ptr + params.sq_off.head);
+    sq_tail = (unsigned *)((char *)sq_ptr + params.sq_off.tail);
+    sq_mask = (unsigned *)((char *)sq_ptr + params.sq_off.ring_mask);
+    sq_array = (unsigned *)((char *)sq_ptr + params.sq_off.array);
+    sq_local_tail = *sq_tail;
+    cq_head = (unsigned *)((char *)cq_ptr + params.cq_off.head);
+    cq_tail = (unsigned *)((char *)cq_ptr + params.cq_off.tail);
+    cq_mask = (unsigned *)((char *)cq_ptr + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)((char *)cq_ptr + params.cq_off.cqes);
+
+    // ring of provided buffers (Linux 5.19+), one datagram per buffer
+    void *ring_mem = mmap(NULL, URING_RECV_BUFS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring_mem == MAP_FAILED) return false;
+    buf_ring = (struct io_uring_buf_ring *)ring_mem;
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (__u64)buf_ring;
+    reg.ring_entries = URING_RECV_BUFS;
+    reg.bgid = BUF_GROUP;
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) return false;
+    recv_bufs = (char *) malloc(URING_RECV_BUFS * sizeof(segment));
+    for (int bid = 0; bid < URING_RECV_BUFS; bid++) recycleBuffer(bid);
+
+    // multishot recv (Linux 6.0+) is rejected right away where unsupported
+    armRecv();
+    enter(false, -1);
+    reapCompletions();
+    return !recv_unsupported;
+}
+
+struct io_uring_sqe *uring_transport::getSqe(){
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) enter(false, -1);
+    unsigned index = sq_local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[index] = index;
+    sq_local_tail++;
+    to_submit++;
+    return sqe;
+}
+
+bool uring_transport::enter(bool wait, long long timeout_us){
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    void *argp = NULL;
+    size_t argsz = 0;
+    if (wait && timeout_us >= 0){
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = timeout_us % 1000000 * 1000;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = (__u64)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+        argp = &arg;
+        argsz = sizeof(arg);
+    }
+
+    int result = syscall(__NR_io_uring_enter, ring_fd, to_submit, wait ? 1 : 0, flags, argp, argsz);
+    statInc(STAT_SYS_IO_URING_ENTER);
+    if (result < 0){
+        if (errno == ETIME) return false;
+        if (errno == EINTR) return true;
+        perror("Error in io_uring_enter");
+        exit(EXIT_FAILURE);
+    }
+    to_submit -= (unsigned)result < to_submit ? result : to_submit;
+    return true;
+}
+
+void uring_transport::reapCompletions(){
+    unsigned head = *cq_head;
+    while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)){
+        struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        int kind = cqe->user_data & 0xff, index = cqe->user_data >> 8;
+
+        if (kind == KIND_RECV){
+            // without F_MORE the multishot recv is over (e.g. out of buffers), post it again later
+            if (!(cqe->flags & IORING_CQE_F_MORE)) recv_armed = false;
+            if (cqe->flags & IORING_CQE_F_BUFFER){
+                int bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                if (cqe->res > 0){
+                    int tail = (ready_head + ready_count) % URING_RECV_BUFS;
+                    ready_bid[tail] = bid;
+                    ready_len[tail] = cqe->res;
+                    ready_count++;
+                }
+                else recycleBuffer(bid);
+            }
+            else if (cqe->res == -EINVAL) recv_unsupported = true;
+            else if (cqe->res < 0 && cqe->res != -ENOBUFS){
+                fprintf(stderr, "Error in io_uring recv: %s\n", strerror(-cqe->res));
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (kind == KIND_SEND){
+            send_slots[index].busy = false;
+            sends_in_flight--;
+        }
+        else if (kind == KIND_WRITE){
+            write_slot *w = &write_slots[index];
+            if (cqe->res < 0){
+                fprintf(stderr, "Error writing file: %s\n", strerror(-cqe->res));
+                exit(EXIT_FAILURE);
+            }
+            // short write: finish it synchronously, this is not expected for regular files
+            for (int done = cqe->res; done < w->len; ){
+                int n = pwrite(w->fd, w->buf + done, w->len - done, w->offset + done);
+                statInc(STAT_SYS_WRITE);
+                if (n <= 0){
+                    perror("Error writing file");
+                    exit(EXIT_FAILURE);
+                }
+                done += n;
+            }
+            close(w->fd);
+            free(w->buf);
+            w->busy = false;
+            writes_in_flight--;
+        }
+        head++;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+void uring_transport::armRecv(){
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sock_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUF_GROUP;
+    sqe->user_data = USER_DATA(KIND_RECV, 0);
+    recv_armed = true;
+}
+
+void uring_transport::recycleBuffer(int bid){
+    // the ring is a plain array of io_uring_buf whose first entry's resv field
+    // is the tail; the flex-array union in the header is laid out differently
+    // when compiled as C++, so index it by hand
+    struct io_uring_buf *buf = (struct io_uring_buf *)buf_ring + (buf_tail & (URING_RECV_BUFS - 1));
+    buf->addr = (__u64)(recv_bufs + (size_t)bid * sizeof(segment));
+    buf->len = sizeof(segment);
+    buf->bid = bid;
+    buf_tail++;
+    __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+void uring_transport::send(segment *sgmt){
+    int index = -1;
+    while (true){
+        for (int i = 0; i < URING_SEND_SLOTS; i++){
+            if (!send_slots[i].busy){
+                index = i;
+                break;
+            }
+        }
+        if (index >= 0) break;
+        enter(true, -1);
+        reapCompletions();
+    }
+
+    send_slot *slot = &send_slots[index];
+    slot->busy = true;
+    sends_in_flight++;
+    memcpy(&slot->sgmt, sgmt, sizeof(*sgmt));
+    slot->iov.iov_base = &slot->sgmt;
+    slot->iov.iov_len = sizeof(slot->sgmt);
+    memset(&slot->msg, 0, sizeof(slot->msg));
+    slot->msg.msg_name = &peer_addr;
+    slot->msg.msg_namelen = sizeof(peer_addr);
+    slot->msg.msg_iov = &slot->iov;
+    slot->msg.msg_iovlen = 1;
+
+    // submitted with the next wait in recv(), together with everything else queued
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sock_fd;
+    sqe->addr = (__u64)&slot->msg;
+    sqe->len = 1;
+    sqe->user_data = USER_DATA(KIND_SEND, index);
+}
+
+bool uring_transport::recv(segment *sgmt, long long timeout_us){
+    long long deadline = timeout_us >= 0 ? now() + timeout_us : -1;
+    while (ready_count == 0){
+        reapCompletions();
+        if (ready_count > 0) break;
+        if (!recv_armed) armRecv();
+        long long remaining = deadline < 0 ? -1 : deadline - now();
+        if (deadline >= 0 && remaining <= 0){
+            if (to_submit > 0) enter(false, -1);
+            return false;
+        }
+        enter(true, remaining);
+    }
+    // ACKs queued since the last wait go out now, not once the ready
+    // segments run out: the sender is clocked by them
+    if (to_submit > 0) enter(false, -1);
+
+    int bid = ready_bid[ready_head], len = ready_len[ready_head];
+    memcpy(sgmt, recv_bufs + (size_t)bid * sizeof(segment), len < (int)sizeof(*sgmt) ? len : sizeof(*sgmt));
+    recycleBuffer(bid);
+    ready_head = (ready_head + 1) % URING_RECV_BUFS;
+    ready_count--;
+    return true;
+}
+
+long long uring_transport::now(){
+    return statNowMicros();
+}
+
+void uring_transport::write(int fd, char *buf, int len, long long offset){
+    while (writes_in_flight == URING_WRITE_SLOTS){
+        enter(true, -1);
+        reapCompletions();
+    }
+    int index = 0;
+    while (write_slots[index].busy) index++;
+
+    // a copy of fd, closed once the write has completed: the caller may
+    // close fd right away, and its number be reused by the next open()
+    int write_fd = dup(fd);
+    if (write_fd < 0){
+        perror("Error in dup");
+        exit(EXIT_FAILURE);
+    }
+    write_slot *w = &write_slots[index];
+    w->busy = true;
+    w->fd = write_fd;
+    w->buf = buf;
+    w->len = len;
+    w->offset = offset;
+    writes_in_flight++;
+
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = write_fd;
+    sqe->addr = (__u64)buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = USER_DATA(KIND_WRITE, index);
+    // submit now, the write goes on in the background
+    enter(false, -1);
+}
+
+void uring_transport::drain(){
+    if (to_submit > 0) enter(false, -1);
+    while (sends_in_flight > 0 || writes_in_flight > 0){
+        enter(true, -1);
+        reapCompletions();
+    }
+}
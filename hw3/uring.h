@@ -0,0 +1,99 @@
+/*
+    io_uring backend for the receiver (receiver --uring), on the raw system
+    calls of <linux/io_uring.h>, no liburing.
+
+    One multishot recv stays posted on the UDP socket with a ring of
+    provided buffers, so while segments keep arriving they are picked up
+    from the completion queue without a recv system call. ACKs are queued
+    as sendmsg requests and submitted, in one io_uring_enter() with
+    anything else queued, before the next segment is returned. File writes
+    are submitted as they are handed over and complete in the background.
+*/
+
+#ifndef URING_HEADER
+#define URING_HEADER
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+
+#include "def.h"
+#include "transport.h"
+
+#define URING_ENTRIES 256       // submission queue size
+#define URING_RECV_BUFS 256     // provided buffers, one datagram each (power of 2)
+#define URING_SEND_SLOTS 64     // ACKs in flight
+#define URING_WRITE_SLOTS 64    // file writes in flight
+
+class uring_transport : public transport {
+public:
+    uring_transport(int sock_fd, struct sockaddr_in peer_addr);
+    ~uring_transport();
+    // False if the kernel lacks what is needed (io_uring, provided buffer
+    // rings, multishot recv); use udp_transport instead then
+    bool init();
+
+    void send(segment *sgmt) override;
+    bool recv(segment *sgmt, long long timeout_us) override;
+    long long now() override;
+
+    // Write len bytes of buf at offset of fd in the background. Takes
+    // ownership of buf (malloc-ed), which is freed once written; fd is
+    // duplicated, so the caller may close it at once.
+    void write(int fd, char *buf, int len, long long offset);
+    // Submit whatever is still queued (e.g. the FINACK) and wait until every
+    // ACK and write handed over has completed
+    void drain();
+
+private:
+    struct send_slot {
+        bool busy;
+        segment sgmt;
+        struct iovec iov;
+        struct msghdr msg;
+    };
+    struct write_slot {
+        bool busy;
+        int fd, len;
+        char *buf;
+        long long offset;
+    };
+
+    struct io_uring_sqe *getSqe();
+    // Submit what is queued and, if wait, block until there is a completion
+    // (or timeout_us passes, if >= 0). Returns false on timeout.
+    bool enter(bool wait, long long timeout_us);
+    void reapCompletions();
+    void armRecv();
+    void recycleBuffer(int bid);
+
+    int sock_fd;
+    struct sockaddr_in peer_addr;
+    int ring_fd = -1;
+    unsigned sq_entries = 0;
+
+    // submission queue
+    void *sq_ptr = NULL, *cq_ptr = NULL;
+    size_t sq_size = 0, cq_size = 0;
+    struct io_uring_sqe *sqes = NULL;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_local_tail = 0, to_submit = 0;
+    // completion queue
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // provided buffers for the multishot recv
+    struct io_uring_buf_ring *buf_ring = NULL;
+    char *recv_bufs = NULL;
+    unsigned short buf_tail = 0;
+    bool recv_armed = false;
+    bool recv_unsupported = false;
+    // received segments not yet returned by recv(): buffer id and length
+    int ready_bid[URING_RECV_BUFS], ready_len[URING_RECV_BUFS];
+    int ready_head = 0, ready_count = 0;
+
+    send_slot send_slots[URING_SEND_SLOTS];
+    write_slot write_slots[URING_WRITE_SLOTS];
+    int sends_in_flight = 0, writes_in_flight = 0;
+};
+
+#endif // URING_HEADER